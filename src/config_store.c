@@ -0,0 +1,194 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include "config_store.h"
+#include "controller.h"
+#include "input_filter.h"
+#include "poll_rate.h"
+#include "usb_profiles.h"
+
+/* Controller wiring (PARALLEL_TYPE or SERIAL_TYPE) */
+#ifndef CONTROLLER_TYPE
+#define CONTROLLER_TYPE PARALLEL_TYPE
+#endif
+
+/* USB host the stick enumerates for (SP_PC, SP_PS3 or SP_X360) */
+#ifndef USB_PROFILE
+#define USB_PROFILE SP_PC
+#endif
+
+// One stored copy of the block.  The checksum covers everything before
+// it and is written last.
+struct ConfigSlot
+{
+  uint8_t version;
+  uint16_t sequence;
+  struct Config config;
+  uint16_t checksum;
+};
+
+// Slots that fit in the EEPROM, at most CONFIG_SLOTS.
+#define SLOT_COUNT ((E2END + 1) / sizeof(struct ConfigSlot) < CONFIG_SLOTS ? \
+                    (E2END + 1) / sizeof(struct ConfigSlot) : CONFIG_SLOTS)
+
+static struct ConfigSlot EEMEM configSlots[SLOT_COUNT];
+
+// Settings in use.
+static struct Config config;
+
+// Slot and sequence number of the newest valid copy.
+static uint8_t newestSlot;
+static uint16_t newestSequence;
+
+// Copy being written by config_store_poll(), the slot it goes to and how
+// many of its bytes have been written.
+static struct ConfigSlot pendingSlot;
+static uint8_t pendingSlotIndex;
+static uint8_t pendingOffset = sizeof(struct ConfigSlot);
+
+// Fletcher-16 over the slot up to its checksum.
+static uint16_t slot_checksum(const struct ConfigSlot* slot)
+{
+  const uint8_t* data = (const uint8_t*)slot;
+  uint8_t low = 0;
+  uint8_t high = 0;
+  for (uint8_t i = 0; i < offsetof(struct ConfigSlot, checksum); ++i)
+  {
+    low = (low + data[i]) % 255;
+    high = (high + low) % 255;
+  }
+  return ((uint16_t)high << 8) | low;
+}
+
+// Rejects values that would index past a table, in case a block with the
+// right version and checksum was written by a build with other limits.
+static uint8_t config_valid(const struct Config* candidate)
+{
+  if (candidate->controllerType > PARALLEL_TYPE || candidate->profile > SP_X360 ||
+      candidate->pollRate >= POLL_RATE_COUNT || candidate->pressMode > FILTER_EAGER ||
+      candidate->releaseMode > FILTER_EAGER)
+  {
+    return 0;
+  }
+  for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+  {
+    if (candidate->remap[i] > REMAP_DOWN && candidate->remap[i] != REMAP_NONE)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void init_config_store(void)
+{
+  struct ConfigSlot slot;
+  uint8_t found = 0;
+
+  reset_config();
+  newestSlot = SLOT_COUNT - 1;
+  newestSequence = 0;
+
+  for (uint8_t i = 0; i < SLOT_COUNT; ++i)
+  {
+    eeprom_read_block(&slot, &configSlots[i], sizeof(slot));
+    if (slot.version != CONFIG_VERSION || slot.checksum != slot_checksum(&slot) ||
+        !config_valid(&slot.config))
+    {
+      continue;
+    }
+
+    // Sequence numbers wrap around, so the newest is the one the others
+    // are behind.
+    if (!found || (int16_t)(slot.sequence - newestSequence) > 0)
+    {
+      config = slot.config;
+      newestSlot = i;
+      newestSequence = slot.sequence;
+      found = 1;
+    }
+  }
+}
+
+struct Config* get_config(void)
+{
+  return &config;
+}
+
+void reset_config(void)
+{
+  config.controllerType = CONTROLLER_TYPE;
+  config.profile = USB_PROFILE;
+  config.pollRate = POLL_RATE_1000HZ;
+  config.pressMode = PRESS_FILTER_MODE;
+  config.releaseMode = RELEASE_FILTER_MODE;
+  config.adaptiveDebounce = ADAPTIVE_DEBOUNCE;
+  for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+  {
+    uint8_t stickBits = (i / BITS_PER_BYTE == STICK_STATE_BYTE) ? STICK_STATE_BITS : 0;
+    config.debounceUs[i] = (stickBits & (1 << (i % BITS_PER_BYTE))) ? STICK_DEBOUNCE_US : BUTTON_DEBOUNCE_US;
+  }
+  get_default_input_remap(config.remap);
+}
+
+void save_config(void)
+{
+  // A save that is still being written is started over in the same slot;
+  // otherwise the next slot along is used.
+  if (!config_store_busy())
+  {
+    pendingSlotIndex = (newestSlot + 1) % SLOT_COUNT;
+  }
+  pendingSlot.version = CONFIG_VERSION;
+  pendingSlot.sequence = newestSequence + 1;
+  pendingSlot.config = config;
+  pendingSlot.checksum = slot_checksum(&pendingSlot);
+  pendingOffset = 0;
+}
+
+void config_store_poll(void)
+{
+  if (!config_store_busy() || !eeprom_is_ready())
+  {
+    return;
+  }
+
+  // Unchanged bytes are skipped without a write.
+  uint8_t* slot = (uint8_t*)&configSlots[pendingSlotIndex];
+  eeprom_update_byte(slot + pendingOffset, ((const uint8_t*)&pendingSlot)[pendingOffset]);
+  if (++pendingOffset == sizeof(struct ConfigSlot))
+  {
+    newestSlot = pendingSlotIndex;
+    newestSequence = pendingSlot.sequence;
+  }
+}
+
+uint8_t config_store_busy(void)
+{
+  return pendingOffset < sizeof(struct ConfigSlot);
+}
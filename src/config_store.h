@@ -0,0 +1,102 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __CONFIG_STORE__
+#define __CONFIG_STORE__
+
+#include "input_remap.h"
+#include <stdint.h>
+
+// Settings that can be changed without reflashing, kept in EEPROM.  The
+// stored block is loaded once at boot into a RAM cache, and every module
+// reads its settings from the cache when it is initialized, so the main
+// loop never touches the EEPROM.
+//
+// The block is versioned and checksummed and written to one of up to
+// CONFIG_SLOTS slots in turn, so each save wears a different part of the
+// EEPROM.  Builds with more state bytes have a larger block and fit fewer
+// slots.  The newest valid slot wins at boot; a save cut short by a
+// reset leaves an invalid slot and the previous settings are kept.  If no
+// slot is valid, or the version does not match, the defaults below and
+// in pins.h are used.
+
+// Layout version of struct Config.  Bump it whenever the struct changes.
+#define CONFIG_VERSION 1
+
+// Most slots the block is rotated through.
+#define CONFIG_SLOTS 8
+
+struct Config
+{
+  // Controller wiring (enum ControllerType).
+  uint8_t controllerType;
+
+  // USB host the stick enumerates for (Profile).
+  uint8_t profile;
+
+  // Polling rate (enum PollRate).
+  uint8_t pollRate;
+
+  // Filter modes for presses and releases (enum InputFilterMode), and
+  // whether debounce windows adapt to the measured bounce.
+  uint8_t pressMode;
+  uint8_t releaseMode;
+  uint8_t adaptiveDebounce;
+
+  // Debounce window, or its upper bound with adaptive windows, of each
+  // input in microseconds, indexed by state byte * 8 + bit number.
+  uint16_t debounceUs[REMAP_NUM_INPUTS];
+
+  // USB output (enum RemapOutput) of each input, indexed the same way.
+  uint8_t remap[REMAP_NUM_INPUTS];
+};
+
+// Loads the newest valid block from EEPROM into the cache, or the
+// defaults if there is none.  Must be called once before any other
+// module is initialized.
+void init_config_store(void);
+
+// Returns the cached settings.  Changes take effect when the modules
+// that use them are next configured, and are kept across a reset once
+// save_config() has written them.
+struct Config* get_config(void);
+
+// Puts the defaults in the cache.
+void reset_config(void);
+
+// Starts writing the cache to the next slot.  The write is done by
+// config_store_poll() in the background; a save while one is in progress
+// starts it over with the latest settings.
+void save_config(void);
+
+// Writes the next byte of a save if the EEPROM is ready for it.  Called
+// once per main loop pass; a byte takes about 3.4 ms to program, so a
+// save finishes within a few hundred passes without stalling any.
+void config_store_poll(void);
+
+// Returns 1 while a save is being written.
+uint8_t config_store_busy(void);
+
+#endif //#ifndef __CONFIG_STORE__
@@ -27,6 +27,7 @@
 #include "controller.h"
 #include "serial_controller.h"
 #include "parallel_controller.h"
+#include "timer.h"
 
 void init_controller(struct Controller* controller, enum ControllerType controllerType)
 {
@@ -44,16 +45,29 @@ void init_controller(struct Controller* controller, enum ControllerType controll
   }
 }
 
-void get_controller_state(struct Controller* controller, uint8_t pins[NUM_CONTROLLER_STATE_BYTES])
+void get_controller_state(struct Controller* controller, uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp)
 {
   switch(controller->controllerType)
   {
   case SERIAL_TYPE:
-    get_controller_state_serial(pins);
+    get_controller_state_serial(pins, timestamp);
     break;
   case PARALLEL_TYPE:
   default:
+    *timestamp = timer_now();
     get_controller_state_parallel(pins);
     break;
   }
 }
+
+uint8_t get_controller_edge(struct Controller* controller, uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp)
+{
+  switch(controller->controllerType)
+  {
+  case SERIAL_TYPE:
+    return 0;
+  case PARALLEL_TYPE:
+  default:
+    return get_controller_edge_parallel(pins, timestamp);
+  }
+}
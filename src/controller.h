@@ -48,7 +48,14 @@ struct Controller
 // Must be called once to initialize the controller interface.
 void init_controller(struct Controller* controller, enum ControllerType controllerType);
 
-// Returns the state of joystick and buttons.
-void get_controller_state(struct Controller* controller, uint8_t pins[NUM_CONTROLLER_STATE_BYTES]);
+// Returns the state of joystick and buttons, with the timer.h timestamp
+// of the moment it was sampled.  Controllers that scan ahead return an
+// earlier sample than the time of the call.
+void get_controller_state(struct Controller* controller, uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp);
+
+// Returns 1 and the state of joystick and buttons at the oldest input edge
+// captured since the last call, with its timer.h timestamp, or 0 if there
+// are none.  Controllers without edge capture always return 0.
+uint8_t get_controller_edge(struct Controller* controller, uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp);
 
 #endif
@@ -0,0 +1,310 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Host build replacement for avr-libc's <avr/io.h>.  Every I/O register
+// of the ATmega32U4 used by the firmware is an lvalue that goes through
+// host_reg8() / host_reg16() (see host_io.h), so the firmware sources
+// compile unchanged and a test bench can observe or drive each access.
+
+#ifndef __HOST_AVR_IO_H__
+#define __HOST_AVR_IO_H__
+
+#include <stdint.h>
+#include "host_io.h"
+
+#define __AVR_ATmega32U4__ 1
+
+// Last EEPROM address
+#define E2END 0x3FF
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+// 8-bit registers
+#define PINB       HOST_REG8(HOST_PINB)
+#define DDRB       HOST_REG8(HOST_DDRB)
+#define PORTB      HOST_REG8(HOST_PORTB)
+#define PINC       HOST_REG8(HOST_PINC)
+#define DDRC       HOST_REG8(HOST_DDRC)
+#define PORTC      HOST_REG8(HOST_PORTC)
+#define PIND       HOST_REG8(HOST_PIND)
+#define DDRD       HOST_REG8(HOST_DDRD)
+#define PORTD      HOST_REG8(HOST_PORTD)
+#define PINE       HOST_REG8(HOST_PINE)
+#define DDRE       HOST_REG8(HOST_DDRE)
+#define PORTE      HOST_REG8(HOST_PORTE)
+#define PINF       HOST_REG8(HOST_PINF)
+#define DDRF       HOST_REG8(HOST_DDRF)
+#define PORTF      HOST_REG8(HOST_PORTF)
+#define SREG       HOST_REG8(HOST_SREG)
+#define CLKPR      HOST_REG8(HOST_CLKPR)
+#define MCUSR      HOST_REG8(HOST_MCUSR)
+#define TIFR0      HOST_REG8(HOST_TIFR0)
+#define TIFR1      HOST_REG8(HOST_TIFR1)
+#define TIFR3      HOST_REG8(HOST_TIFR3)
+#define TIMSK0     HOST_REG8(HOST_TIMSK0)
+#define TIMSK1     HOST_REG8(HOST_TIMSK1)
+#define TIMSK3     HOST_REG8(HOST_TIMSK3)
+#define TCCR0A     HOST_REG8(HOST_TCCR0A)
+#define TCCR0B     HOST_REG8(HOST_TCCR0B)
+#define TCNT0      HOST_REG8(HOST_TCNT0)
+#define TCCR1A     HOST_REG8(HOST_TCCR1A)
+#define TCCR1B     HOST_REG8(HOST_TCCR1B)
+#define TCCR1C     HOST_REG8(HOST_TCCR1C)
+#define TCCR3A     HOST_REG8(HOST_TCCR3A)
+#define TCCR3B     HOST_REG8(HOST_TCCR3B)
+#define TCCR3C     HOST_REG8(HOST_TCCR3C)
+#define PCIFR      HOST_REG8(HOST_PCIFR)
+#define PCICR      HOST_REG8(HOST_PCICR)
+#define PCMSK0     HOST_REG8(HOST_PCMSK0)
+#define EIFR       HOST_REG8(HOST_EIFR)
+#define EIMSK      HOST_REG8(HOST_EIMSK)
+#define EICRA      HOST_REG8(HOST_EICRA)
+#define EICRB      HOST_REG8(HOST_EICRB)
+#define SPCR       HOST_REG8(HOST_SPCR)
+#define SPSR       HOST_REG8(HOST_SPSR)
+#define SPDR       HOST_REG8(HOST_SPDR)
+#define UHWCON     HOST_REG8(HOST_UHWCON)
+#define USBCON     HOST_REG8(HOST_USBCON)
+#define USBSTA     HOST_REG8(HOST_USBSTA)
+#define USBINT     HOST_REG8(HOST_USBINT)
+#define PLLCSR     HOST_REG8(HOST_PLLCSR)
+#define PLLFRQ     HOST_REG8(HOST_PLLFRQ)
+#define UDCON      HOST_REG8(HOST_UDCON)
+#define UDINT      HOST_REG8(HOST_UDINT)
+#define UDIEN      HOST_REG8(HOST_UDIEN)
+#define UDADDR     HOST_REG8(HOST_UDADDR)
+#define UDFNUML    HOST_REG8(HOST_UDFNUML)
+#define UDFNUMH    HOST_REG8(HOST_UDFNUMH)
+#define UDMFN      HOST_REG8(HOST_UDMFN)
+#define UEINTX     HOST_REG8(HOST_UEINTX)
+#define UENUM      HOST_REG8(HOST_UENUM)
+#define UERST      HOST_REG8(HOST_UERST)
+#define UECONX     HOST_REG8(HOST_UECONX)
+#define UECFG0X    HOST_REG8(HOST_UECFG0X)
+#define UECFG1X    HOST_REG8(HOST_UECFG1X)
+#define UESTA0X    HOST_REG8(HOST_UESTA0X)
+#define UESTA1X    HOST_REG8(HOST_UESTA1X)
+#define UEIENX     HOST_REG8(HOST_UEIENX)
+#define UEDATX     HOST_REG8(HOST_UEDATX)
+#define UEBCLX     HOST_REG8(HOST_UEBCLX)
+#define UEBCHX     HOST_REG8(HOST_UEBCHX)
+#define UEINT      HOST_REG8(HOST_UEINT)
+
+// 16-bit registers
+#define TCNT1      HOST_REG16(HOST_TCNT1)
+#define OCR1A      HOST_REG16(HOST_OCR1A)
+#define OCR1B      HOST_REG16(HOST_OCR1B)
+#define OCR1C      HOST_REG16(HOST_OCR1C)
+#define ICR1       HOST_REG16(HOST_ICR1)
+#define TCNT3      HOST_REG16(HOST_TCNT3)
+#define OCR3A      HOST_REG16(HOST_OCR3A)
+#define OCR3B      HOST_REG16(HOST_OCR3B)
+#define OCR3C      HOST_REG16(HOST_OCR3C)
+#define ICR3       HOST_REG16(HOST_ICR3)
+
+// Register bits
+
+// PORTx / DDRx / PINx
+#define PB0        0
+#define PB1        1
+#define PB2        2
+#define PB3        3
+#define PB4        4
+#define PB5        5
+#define PB6        6
+#define PB7        7
+#define PC6        6
+#define PC7        7
+#define PD0        0
+#define PD1        1
+#define PD2        2
+#define PD3        3
+#define PD4        4
+#define PD5        5
+#define PD6        6
+#define PD7        7
+#define PE2        2
+#define PE6        6
+#define PF0        0
+#define PF1        1
+#define PF4        4
+#define PF5        5
+#define PF6        6
+#define PF7        7
+#define DDB0       0
+#define DDB1       1
+#define DDB2       2
+#define DDB3       3
+#define DDB4       4
+#define DDB5       5
+#define DDB6       6
+#define DDB7       7
+#define DDD0       0
+#define DDD1       1
+#define DDD2       2
+#define DDD3       3
+#define DDD4       4
+#define DDD5       5
+#define DDD6       6
+#define DDD7       7
+
+// TIMSKn / TIFRn / TCCRnB
+#define TOIE1      0
+#define OCIE1A     1
+#define OCIE1B     2
+#define OCIE1C     3
+#define ICIE1      5
+#define TOV1       0
+#define OCF1A      1
+#define OCF1B      2
+#define OCF1C      3
+#define ICF1       5
+#define TOIE3      0
+#define OCIE3A     1
+#define OCIE3B     2
+#define OCIE3C     3
+#define ICIE3      5
+#define TOV3       0
+#define OCF3A      1
+#define OCF3B      2
+#define OCF3C      3
+#define ICF3       5
+#define CS10       0
+#define CS11       1
+#define CS12       2
+#define WGM12      3
+#define WGM13      4
+#define CS30       0
+#define CS31       1
+#define CS32       2
+#define WGM32      3
+#define WGM33      4
+
+// PCICR / PCIFR / EICRA / EIMSK / EIFR
+#define PCIE0      0
+#define PCIF0      0
+#define ISC00      0
+#define ISC01      1
+#define ISC10      2
+#define ISC11      3
+#define ISC20      4
+#define ISC21      5
+#define ISC30      6
+#define ISC31      7
+#define INT0       0
+#define INT1       1
+#define INT2       2
+#define INT3       3
+#define INT6       6
+#define INTF0      0
+#define INTF1      1
+#define INTF2      2
+#define INTF3      3
+#define INTF6      6
+
+// SPCR / SPSR
+#define SPR0       0
+#define SPR1       1
+#define CPHA       2
+#define CPOL       3
+#define MSTR       4
+#define DORD       5
+#define SPE        6
+#define SPIE       7
+#define SPI2X      0
+#define WCOL       6
+#define SPIF       7
+
+// PLLCSR / USBCON / UHWCON / UDCON
+#define PLOCK      0
+#define PLLE       1
+#define PINDIV     4
+#define VBUSTE     0
+#define OTGPADE    4
+#define FRZCLK     5
+#define USBE       7
+#define UVREGE     0
+#define DETACH     0
+#define RMWKUP     1
+#define LSM        2
+#define RSTCPU     3
+
+// UDINT / UDIEN / UDADDR
+#define SUSPI      0
+#define SOFI       2
+#define EORSTI     3
+#define WAKEUPI    4
+#define EORSMI     5
+#define UPRSMI     6
+#define SUSPE      0
+#define SOFE       2
+#define EORSTE     3
+#define WAKEUPE    4
+#define EORSME     5
+#define UPRSME     6
+#define ADDEN      7
+
+// UEINTX / UEIENX / UECONX / UESTA0X / UECFG0X / UECFG1X
+#define TXINI      0
+#define STALLEDI   1
+#define RXOUTI     2
+#define RXSTPI     3
+#define NAKOUTI    4
+#define RWAL       5
+#define NAKINI     6
+#define FIFOCON    7
+#define TXINE      0
+#define STALLEDE   1
+#define RXOUTE     2
+#define RXSTPE     3
+#define NAKOUTE    4
+#define NAKINE     6
+#define FLERRE     7
+#define EPEN       0
+#define RSTDT      3
+#define STALLRQC   4
+#define STALLRQ    5
+#define NBUSYBK0   0
+#define NBUSYBK1   1
+#define DTSEQ0     2
+#define DTSEQ1     3
+#define UNDERFI    5
+#define OVERFI     6
+#define CFGOK      7
+#define EPDIR      0
+#define EPTYPE0    6
+#define EPTYPE1    7
+#define ALLOC      1
+#define EPBK0      2
+#define EPBK1      3
+#define EPSIZE0    4
+#define EPSIZE1    5
+#define EPSIZE2    6
+
+#endif
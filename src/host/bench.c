@@ -0,0 +1,266 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Micro-benchmarks for the input pipeline, built natively with
+// "make bench".  Each benchmark runs its operation in a loop and reports
+// the average time per operation.  Register accesses go through the host
+// register model, so the numbers are for comparing changes to the hot
+// path on one machine, not absolute AVR cycle counts.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <avr/io.h>
+#include "../pins.h"
+#include "../timer.h"
+#include "../controller.h"
+#include "../serial_controller.h"
+#include "../input_filter.h"
+#include "../input_remap.h"
+#include "../config_store.h"
+#include "../latency_stats.h"
+#include "../loop_monitor.h"
+#include "../usb_gamepad.h"
+#include "../usb_profiles.h"
+
+#define DEFAULT_ITERATIONS 2000000UL
+
+// Interrupt handlers of the firmware, called directly to raise them.
+void PCINT0_vect(void);
+void SPI_STC_vect(void);
+
+static unsigned long iterations = DEFAULT_ITERATIONS;
+static volatile uint8_t sink;
+
+static struct Controller controller;
+static struct InputFilter inputFilter;
+static struct InputRemap inputRemap;
+static uint8_t pins[NUM_CONTROLLER_STATE_BYTES];
+static uint16_t sampleTime;
+
+static uint64_t now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void run(const char* name, void (*setup)(void), void (*op)(unsigned long i))
+{
+  if (setup)
+  {
+    setup();
+  }
+
+  uint64_t start = now_ns();
+  for (unsigned long i = 0; i < iterations; ++i)
+  {
+    op(i);
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  printf("%-28s %10.1f ns/op\n", name, (double)elapsed / iterations);
+}
+
+// Port values that flip one input every 64 samples.
+static void set_ports(unsigned long i)
+{
+  PINB = (i & 64) ? 0xF7 : 0xFF;
+  PINF = (i & 128) ? 0xFE : 0xFF;
+}
+
+static void setup_parallel(void)
+{
+  init_controller(&controller, PARALLEL_TYPE);
+}
+
+static void op_parallel_sample(unsigned long i)
+{
+  set_ports(i);
+  get_controller_state(&controller, pins, &sampleTime);
+  sink = pins[0] ^ pins[1];
+}
+
+static void op_edge_capture(unsigned long i)
+{
+  uint16_t timestamp;
+  set_ports(i);
+  PCINT0_vect();
+  while (get_controller_edge(&controller, pins, &timestamp))
+  {
+    sink = pins[0] ^ pins[1];
+  }
+}
+
+// Every SPI transfer completes at once.
+static void setup_serial(void)
+{
+  SPSR = (1<<SPIF);
+  init_controller(&controller, SERIAL_TYPE);
+}
+
+// Takes the last scan and starts the next, then runs the SPI interrupt
+// for each byte of it, as the target does between two samples.
+static void op_serial_sample(unsigned long i)
+{
+  get_controller_state(&controller, pins, &sampleTime);
+  sink = pins[0] ^ pins[1];
+  for (uint8_t n = NUM_CONTROLLER_STATE_BYTES; n; --n)
+  {
+    SPI_STC_vect();
+  }
+}
+
+static void setup_filter_debounced(void)
+{
+  init_input_filter(&inputFilter);
+}
+
+static void setup_filter_eager(void)
+{
+  init_input_filter(&inputFilter);
+  set_input_filter_mode(&inputFilter, FILTER_EAGER, FILTER_EAGER);
+}
+
+// Raw input that bounces for a while after every change.
+static void op_filter(unsigned long i)
+{
+  pins[0] = ((i & 1023) < 512) ^ ((i & 1023) < 8 && (i & 1)) ? B_05 : 0;
+  pins[1] = (i & 2048) ? (D_LT | B_01) : 0;
+  filter_input(&inputFilter, pins);
+  sink = pins[0] ^ pins[1];
+}
+
+static void setup_remap(void)
+{
+  init_input_remap(&inputRemap);
+}
+
+static void op_remap(unsigned long i)
+{
+  uint8_t x, y, b[2];
+  pins[0] = i;
+  pins[1] = i >> 8;
+  remap_input(&inputRemap, pins, &x, &y, b);
+  sink = x ^ y ^ b[0] ^ b[1];
+}
+
+static void op_publish(unsigned long i)
+{
+  uint8_t b[2] = {i, i >> 8};
+  usb_gamepad_action(i & 0xFF, 128, b);
+}
+
+// The per-pass marks of the main loop, with a change every 64 passes,
+// and the handoff done by the report commit interrupt.
+static void op_latency_marks(unsigned long i)
+{
+  pins[0] = (i & 64) ? B_05 : 0;
+  pins[1] = 0;
+  latency_mark_sample(pins, i);
+  latency_mark_commit(pins, i + 1);
+  latency_mark_publish(i + 2);
+  latency_mark_handoff(1, i + 3);
+}
+
+// A main loop pass, with a new frame every 16 passes.
+static void op_loop_monitor(unsigned long i)
+{
+  UDFNUML = i >> 4;
+  loop_monitor_pass();
+}
+
+static ReportWriter reportWriter;
+
+static void setup_writer_pc(void)
+{
+  reportWriter = get_report_writer(SP_PC);
+}
+
+static void setup_writer_ps3(void)
+{
+  reportWriter = get_report_writer(SP_PS3);
+}
+
+static void setup_writer_x360(void)
+{
+  reportWriter = get_report_writer(SP_X360);
+}
+
+static void op_report_writer(unsigned long i)
+{
+  struct gamepad_state state = {i & 0xFF, 128, {i, i >> 8}};
+  reportWriter(&state);
+  sink = UEDATX;
+}
+
+static void op_descriptor_lookup(unsigned long i)
+{
+  static const uint16_t keys[][2] =
+  {
+    {0x0100, 0x0000}, {0x0200, 0x0000}, {0x2200, GAMEPAD_INTERFACE},
+    {0x0301, 0x0409}, {0x0302, 0x0409}, {0x0303, 0x0409}
+  };
+  const uint8_t* addr;
+  uint8_t len = 0;
+  unsigned k = i % (sizeof(keys) / sizeof(keys[0]));
+  get_descriptor(SP_PC, keys[k][0], keys[k][1], &addr, &len);
+  sink = len;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 1)
+  {
+    iterations = strtoul(argv[1], 0, 0);
+  }
+  if (iterations == 0)
+  {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  host_eeprom_erase();
+  init_config_store();
+  init_timer();
+
+  run("parallel sample", setup_parallel, op_parallel_sample);
+  run("parallel edge capture+drain", setup_parallel, op_edge_capture);
+  run("serial sample", setup_serial, op_serial_sample);
+  run("filter pass (debounced)", setup_filter_debounced, op_filter);
+  run("filter pass (eager)", setup_filter_eager, op_filter);
+  run("remap", setup_remap, op_remap);
+  run("report publish", 0, op_publish);
+  run("latency marks", 0, op_latency_marks);
+  run("loop monitor pass", 0, op_loop_monitor);
+  run("report writer (PC)", setup_writer_pc, op_report_writer);
+  run("report writer (PS3)", setup_writer_ps3, op_report_writer);
+  run("report writer (X360)", setup_writer_x360, op_report_writer);
+  run("descriptor lookup (PC)", 0, op_descriptor_lookup);
+  return 0;
+}
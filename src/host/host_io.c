@@ -0,0 +1,94 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <string.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "host_io.h"
+
+volatile uint8_t host_reg8_storage[HOST_NUM_REG8];
+volatile uint16_t host_reg16_storage[HOST_NUM_REG16];
+
+HostReg8Hook host_reg8_hook = 0;
+HostReg16Hook host_reg16_hook = 0;
+
+volatile uint16_t* host_reg16_default(enum HostReg16 reg)
+{
+  if (reg == HOST_TCNT1)
+  {
+    // Timer1 runs at F_CPU/64 once a clock source is selected.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if (host_reg8_storage[HOST_TCCR1B] & 0x07)
+    {
+      host_reg16_storage[reg] = (uint16_t)(ns / (64000000000ULL / F_CPU));
+    }
+  }
+  return &host_reg16_storage[reg];
+}
+
+// EEMEM variables are placed in their own section, which stands in for
+// the EEPROM.  The linker provides its bounds.
+extern uint8_t __start_host_eeprom[];
+extern uint8_t __stop_host_eeprom[];
+
+void host_eeprom_erase(void)
+{
+  memset(__start_host_eeprom, 0xFF, __stop_host_eeprom - __start_host_eeprom);
+}
+
+uint8_t eeprom_read_byte(const uint8_t* addr)
+{
+  return *addr;
+}
+
+void eeprom_write_byte(uint8_t* addr, uint8_t value)
+{
+  *addr = value;
+}
+
+void eeprom_update_byte(uint8_t* addr, uint8_t value)
+{
+  *addr = value;
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+  memcpy(dst, src, n);
+}
+
+void eeprom_write_block(const void* src, void* dst, size_t n)
+{
+  memcpy(dst, src, n);
+}
+
+void eeprom_update_block(const void* src, void* dst, size_t n)
+{
+  memcpy(dst, src, n);
+}
@@ -0,0 +1,158 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Register model behind the host build's <avr/io.h>.  Registers live in
+// plain arrays.  A test bench can install hooks to see every register
+// access and return its own storage, which is how a simulated peripheral
+// (a USB host, a timer, a pin change) is attached.
+
+#ifndef __HOST_IO_H__
+#define __HOST_IO_H__
+
+#include <stdint.h>
+
+enum HostReg8
+{
+  HOST_PINB,
+  HOST_DDRB,
+  HOST_PORTB,
+  HOST_PINC,
+  HOST_DDRC,
+  HOST_PORTC,
+  HOST_PIND,
+  HOST_DDRD,
+  HOST_PORTD,
+  HOST_PINE,
+  HOST_DDRE,
+  HOST_PORTE,
+  HOST_PINF,
+  HOST_DDRF,
+  HOST_PORTF,
+  HOST_SREG,
+  HOST_CLKPR,
+  HOST_MCUSR,
+  HOST_TIFR0,
+  HOST_TIFR1,
+  HOST_TIFR3,
+  HOST_TIMSK0,
+  HOST_TIMSK1,
+  HOST_TIMSK3,
+  HOST_TCCR0A,
+  HOST_TCCR0B,
+  HOST_TCNT0,
+  HOST_TCCR1A,
+  HOST_TCCR1B,
+  HOST_TCCR1C,
+  HOST_TCCR3A,
+  HOST_TCCR3B,
+  HOST_TCCR3C,
+  HOST_PCIFR,
+  HOST_PCICR,
+  HOST_PCMSK0,
+  HOST_EIFR,
+  HOST_EIMSK,
+  HOST_EICRA,
+  HOST_EICRB,
+  HOST_SPCR,
+  HOST_SPSR,
+  HOST_SPDR,
+  HOST_UHWCON,
+  HOST_USBCON,
+  HOST_USBSTA,
+  HOST_USBINT,
+  HOST_PLLCSR,
+  HOST_PLLFRQ,
+  HOST_UDCON,
+  HOST_UDINT,
+  HOST_UDIEN,
+  HOST_UDADDR,
+  HOST_UDFNUML,
+  HOST_UDFNUMH,
+  HOST_UDMFN,
+  HOST_UEINTX,
+  HOST_UENUM,
+  HOST_UERST,
+  HOST_UECONX,
+  HOST_UECFG0X,
+  HOST_UECFG1X,
+  HOST_UESTA0X,
+  HOST_UESTA1X,
+  HOST_UEIENX,
+  HOST_UEDATX,
+  HOST_UEBCLX,
+  HOST_UEBCHX,
+  HOST_UEINT,
+  HOST_NUM_REG8
+};
+
+enum HostReg16
+{
+  HOST_TCNT1,
+  HOST_OCR1A,
+  HOST_OCR1B,
+  HOST_OCR1C,
+  HOST_ICR1,
+  HOST_TCNT3,
+  HOST_OCR3A,
+  HOST_OCR3B,
+  HOST_OCR3C,
+  HOST_ICR3,
+  HOST_NUM_REG16
+};
+
+typedef volatile uint8_t* (*HostReg8Hook)(enum HostReg8 reg);
+typedef volatile uint16_t* (*HostReg16Hook)(enum HostReg16 reg);
+
+extern volatile uint8_t host_reg8_storage[HOST_NUM_REG8];
+extern volatile uint16_t host_reg16_storage[HOST_NUM_REG16];
+
+// Optional register hooks, called on every access when set.
+extern HostReg8Hook host_reg8_hook;
+extern HostReg16Hook host_reg16_hook;
+
+// Without a hook, TCNT1 follows the host's monotonic clock at the rate of
+// the real Timer1 and every other register is plain storage.
+volatile uint16_t* host_reg16_default(enum HostReg16 reg);
+
+static inline volatile uint8_t* host_reg8(enum HostReg8 reg)
+{
+  return host_reg8_hook ? host_reg8_hook(reg) : &host_reg8_storage[reg];
+}
+
+static inline volatile uint16_t* host_reg16(enum HostReg16 reg)
+{
+  return host_reg16_hook ? host_reg16_hook(reg) : host_reg16_default(reg);
+}
+
+#define HOST_REG8(reg) (*host_reg8(reg))
+#define HOST_REG16(reg) (*host_reg16(reg))
+
+// Sets every EEMEM variable to the erased value 0xFF.  EEMEM variables
+// start out zeroed, like the .eep image of an unprogrammed layout.
+void host_eeprom_erase(void);
+
+#endif
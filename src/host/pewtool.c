@@ -0,0 +1,457 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Reads the firmware's vendor feature reports (see usb_gamepad.h) from a
+// Linux hidraw node, so a stick can be profiled and tuned in the field:
+//
+//   pewtool /dev/hidrawN loop [count]   main loop and interrupt load,
+//                                       one line per window
+//   pewtool /dev/hidrawN latency        input latency histograms
+//   pewtool /dev/hidrawN boot           boot timing
+//   pewtool /dev/hidrawN filter         switch bounce and debounce
+//                                       windows of each input
+//   pewtool /dev/hidrawN config         settings in use
+//   pewtool /dev/hidrawN window INPUT US
+//   pewtool /dev/hidrawN mode PRESS RELEASE [adaptive|fixed]
+//   pewtool /dev/hidrawN remap INPUT OUTPUT
+//   pewtool /dev/hidrawN rate HZ
+//   pewtool /dev/hidrawN save | defaults
+//                                       change the settings (see tuning.h)
+//
+// The reports are read with HIDIOCGFEATURE and tuning commands are sent
+// with HIDIOCSFEATURE.  They are not in the report descriptor, so the
+// kernel passes them through untouched.  Only the PC and PS3 profiles are
+// HID devices; the X360 profile has no hidraw node.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include "../usb_gamepad.h"
+#include "../latency_stats.h"
+#include "../loop_monitor.h"
+#include "../input_filter.h"
+#include "../input_remap.h"
+#include "../poll_rate.h"
+#include "../tuning.h"
+#include "../pins.h"
+
+#define REPORT_BUFFER_SIZE 256
+
+// How long to wait for the main loop to apply a command, and for a save
+// to be written, in milliseconds.
+#define COMMAND_TIMEOUT_MS 100
+#define SAVE_TIMEOUT_MS 2000
+
+static const char* devicePath;
+
+// Input names by state byte and bit, bit 0 first, as in pins.h, so that
+// input number state byte * 8 + bit indexes them.  Inputs of the extra
+// state bytes are named byte.bit.
+#define STATE_BYTE_NAMES(byte) \
+  #byte ".0", #byte ".1", #byte ".2", #byte ".3", #byte ".4", #byte ".5", #byte ".6", #byte ".7"
+static const char* const inputNames[REMAP_NUM_INPUTS] =
+{
+  "B_12", "B_11", "B_10", "B_09", "B_08", "B_07", "B_06", "B_05",
+  "B_04", "B_03", "B_02", "B_01", "D_DN", "D_UP", "D_RT", "D_LT",
+#if NUM_CONTROLLER_STATE_BYTES > 2
+  STATE_BYTE_NAMES(2),
+#endif
+#if NUM_CONTROLLER_STATE_BYTES > 3
+  STATE_BYTE_NAMES(3),
+#endif
+#if NUM_CONTROLLER_STATE_BYTES > 4
+  STATE_BYTE_NAMES(4),
+#endif
+#if NUM_CONTROLLER_STATE_BYTES > 5
+  STATE_BYTE_NAMES(5),
+#endif
+#if NUM_CONTROLLER_STATE_BYTES > 6
+  STATE_BYTE_NAMES(6),
+#endif
+#if NUM_CONTROLLER_STATE_BYTES > 7
+  STATE_BYTE_NAMES(7),
+#endif
+};
+
+// Output names by enum RemapOutput.
+static const char* const outputNames[] =
+{
+  "BUTTON_01", "BUTTON_02", "BUTTON_03", "BUTTON_04", "BUTTON_05", "BUTTON_06",
+  "BUTTON_07", "BUTTON_08", "BUTTON_09", "BUTTON_10", "BUTTON_11", "BUTTON_12",
+  "LEFT", "RIGHT", "UP", "DOWN"
+};
+
+static const char* const modeNames[] = {"debounced", "eager"};
+
+static uint32_t get_le(const uint8_t* p, unsigned size)
+{
+  uint32_t value = 0;
+
+  while (size--)
+    value = (value << 8) | p[size];
+  return value;
+}
+
+// Reads feature report 'id' into 'report' and checks it is 'size' bytes.
+static void read_report(int fd, uint8_t id, uint8_t* report, int size)
+{
+  int length;
+
+  memset(report, 0, REPORT_BUFFER_SIZE);
+  report[0] = id;
+  length = ioctl(fd, HIDIOCGFEATURE(REPORT_BUFFER_SIZE), report);
+  if (length < 0)
+  {
+    fprintf(stderr, "pewtool: %s: feature report 0x%02X: %s\n", devicePath, id, strerror(errno));
+    exit(1);
+  }
+  if (length != size || report[0] != id)
+  {
+    fprintf(stderr, "pewtool: %s: feature report 0x%02X is %d bytes, expected %d\n",
+            devicePath, id, length, size);
+    exit(1);
+  }
+}
+
+static void print_boot(int fd)
+{
+  uint8_t report[REPORT_BUFFER_SIZE];
+
+  read_report(fd, BOOT_TIMING_REPORT_ID, report, BOOT_TIMING_REPORT_SIZE);
+  printf("usb_init()          %10u us\n", get_le(report + 1, 4));
+  printf("configured          %10u us\n", get_le(report + 5, 4));
+  printf("first report        %10u us\n", get_le(report + 9, 4));
+}
+
+static void print_latency(int fd)
+{
+  static const char* const names[LATENCY_STAGE_COUNT] =
+    {"filter", "publish", "handoff", "total"};
+  uint8_t report[REPORT_BUFFER_SIZE];
+
+  for (unsigned stage = 0; stage < LATENCY_STAGE_COUNT; ++stage)
+  {
+    read_report(fd, LATENCY_REPORT_ID(stage), report, LATENCY_REPORT_SIZE);
+    unsigned usPerTick = report[1];
+    unsigned count = get_le(report + 2, 2);
+    printf("%-8s %9.1f us avg, %u min, %u max over %u changes\n", names[stage],
+           count ? (double)get_le(report + 8, 4) * usPerTick / count : 0.0,
+           (unsigned)get_le(report + 4, 2) * usPerTick,
+           (unsigned)get_le(report + 6, 2) * usPerTick, count);
+    for (unsigned bucket = 0; bucket < LATENCY_BUCKETS; ++bucket)
+    {
+      unsigned hits = get_le(report + 12 + 2 * bucket, 2);
+      unsigned low = bucket ? (1u << (bucket - 1)) * usPerTick : 0;
+
+      if (!hits)
+        continue;
+      if (bucket == LATENCY_BUCKETS - 1)
+        printf("  >= %6u us %8u\n", low, hits);
+      else
+        printf("  <  %6u us %8u\n", (1u << bucket) * usPerTick, hits);
+    }
+  }
+}
+
+static void print_filter(int fd)
+{
+  uint8_t report[REPORT_BUFFER_SIZE];
+
+  printf("%-5s %8s %8s %14s %8s %10s\n", "input", "changes", "chatter", "longest bounce",
+         "escapes", "window");
+  for (unsigned byte = 0; byte < NUM_CONTROLLER_STATE_BYTES; ++byte)
+  {
+    read_report(fd, FILTER_REPORT_ID(byte), report, INPUT_FILTER_REPORT_SIZE);
+    unsigned usPerTick = report[1];
+    unsigned usPerDebounceTick = get_le(report + 2, 2);
+    for (unsigned bit = 0; bit < 8; ++bit)
+    {
+      const uint8_t* input = report + 4 + bit * 8;
+
+      printf("%-5s %8u %8u %11u us %8u %7u us\n", inputNames[byte * 8 + bit],
+             (unsigned)get_le(input, 2), (unsigned)get_le(input + 2, 2),
+             (unsigned)get_le(input + 4, 2) * usPerTick, input[6],
+             input[7] * usPerDebounceTick);
+    }
+  }
+}
+
+static const char* output_name(uint8_t output)
+{
+  if (output == REMAP_NONE)
+    return "NONE";
+  return output < sizeof(outputNames) / sizeof(outputNames[0]) ? outputNames[output] : "?";
+}
+
+static const char* mode_name(uint8_t mode)
+{
+  return mode < sizeof(modeNames) / sizeof(modeNames[0]) ? modeNames[mode] : "?";
+}
+
+static const char* result_name(uint8_t result)
+{
+  static const char* const results[] = {"ok", "unknown command", "bad argument"};
+
+  return result < sizeof(results) / sizeof(results[0]) ? results[result] : "?";
+}
+
+static void print_config(int fd)
+{
+  static const char* const controllers[] = {"serial", "parallel"};
+  static const char* const profiles[] = {"pc", "ps3", "x360"};
+  uint8_t report[REPORT_BUFFER_SIZE];
+
+  read_report(fd, TUNING_REPORT_ID, report, TUNING_REPORT_SIZE);
+  printf("version             %u, last command %u %s%s%s\n", report[1], report[2],
+         result_name(report[3]), report[4] & TUNING_FLAG_SAVING ? ", saving" : "",
+         report[4] & TUNING_FLAG_UNSAVED ? ", not saved" : "");
+  printf("controller          %s\n", report[5] < 2 ? controllers[report[5]] : "?");
+  printf("profile             %s\n", report[6] < 3 ? profiles[report[6]] : "?");
+  printf("report rate         %u Hz, polled at it from the next power-on\n",
+         report[7] < POLL_RATE_COUNT ? 1000 / POLL_RATE_INTERVAL(report[7]) : 0);
+  printf("press               %s\n", mode_name(report[8]));
+  printf("release             %s\n", mode_name(report[9]));
+  printf("windows             %s\n", report[10] ? "adaptive" : "fixed");
+  printf("%-5s %10s  %s\n", "input", "window", "output");
+  for (unsigned i = 0; i < REMAP_NUM_INPUTS; ++i)
+  {
+    printf("%-5s %7u us  %s\n", inputNames[i], (unsigned)get_le(report + 11 + 2 * i, 2),
+           output_name(report[11 + 2 * REMAP_NUM_INPUTS + i]));
+  }
+}
+
+// Looks 'name' up in 'names', ignoring case.  "all" is TUNING_ALL_INPUTS
+// if 'all' is set.  Exits with an error if there is no such name.
+static uint8_t parse_name(const char* what, const char* name, const char* const* names,
+                          unsigned count, int all)
+{
+  if (all && strcasecmp(name, "all") == 0)
+    return TUNING_ALL_INPUTS;
+  for (unsigned i = 0; i < count; ++i)
+  {
+    if (strcasecmp(name, names[i]) == 0)
+      return i;
+  }
+  fprintf(stderr, "pewtool: unknown %s '%s'\n", what, name);
+  exit(1);
+}
+
+// Sends a tuning command and waits until the device has applied it.
+// Returns its result, and waits for the save to be written after
+// TUNING_SAVE.
+static uint8_t send_command(int fd, uint8_t commandId, const uint8_t* args, unsigned count)
+{
+  uint8_t report[REPORT_BUFFER_SIZE];
+  uint8_t command[TUNING_COMMAND_SIZE] = {TUNING_COMMAND_REPORT_ID};
+  unsigned waited;
+
+  // A new sequence number tells this command's outcome from the last.
+  read_report(fd, TUNING_REPORT_ID, report, TUNING_REPORT_SIZE);
+  command[1] = report[2] + 1;
+  command[2] = commandId;
+  memcpy(command + 3, args, count);
+  if (ioctl(fd, HIDIOCSFEATURE(TUNING_COMMAND_SIZE), command) < 0)
+  {
+    fprintf(stderr, "pewtool: %s: tuning command: %s\n", devicePath,
+            errno == EPIPE ? "device busy" : strerror(errno));
+    exit(1);
+  }
+
+  for (waited = 0; ; ++waited)
+  {
+    read_report(fd, TUNING_REPORT_ID, report, TUNING_REPORT_SIZE);
+    if (report[2] == command[1] && !(report[4] & TUNING_FLAG_PENDING)
+        && !(commandId == TUNING_SAVE && (report[4] & TUNING_FLAG_SAVING)))
+      break;
+    if (waited == (commandId == TUNING_SAVE ? SAVE_TIMEOUT_MS : COMMAND_TIMEOUT_MS))
+    {
+      fprintf(stderr, "pewtool: %s: tuning command not applied\n", devicePath);
+      exit(1);
+    }
+    usleep(1000);
+  }
+  if (report[3] != TUNING_OK)
+    fprintf(stderr, "pewtool: %s: tuning command: %s\n", devicePath, result_name(report[3]));
+  return report[3];
+}
+
+static int tune(int fd, int argc, char** argv)
+{
+  const char* command = argv[0];
+  uint8_t args[TUNING_COMMAND_SIZE - 3];
+
+  if (strcmp(command, "window") == 0 && argc == 3)
+  {
+    unsigned long us = strtoul(argv[2], NULL, 0);
+
+    // Too long a window is left for the device to reject.
+    if (us > 0xFFFF)
+      us = 0xFFFF;
+    args[0] = parse_name("input", argv[1], inputNames, REMAP_NUM_INPUTS, 1);
+    args[1] = us & 0xFF;
+    args[2] = us >> 8;
+    return send_command(fd, TUNING_SET_WINDOW, args, 3);
+  }
+  if (strcmp(command, "mode") == 0 && (argc == 3 || argc == 4))
+  {
+    args[0] = parse_name("mode", argv[1], modeNames, 2, 0);
+    args[1] = parse_name("mode", argv[2], modeNames, 2, 0);
+    if (argc == 4 && strcmp(argv[3], "adaptive") != 0 && strcmp(argv[3], "fixed") != 0)
+    {
+      fprintf(stderr, "pewtool: expected adaptive or fixed, not '%s'\n", argv[3]);
+      exit(1);
+    }
+    args[2] = argc == 3 || strcmp(argv[3], "adaptive") == 0;
+    return send_command(fd, TUNING_SET_FILTER_MODE, args, 3);
+  }
+  if (strcmp(command, "remap") == 0 && argc == 3)
+  {
+    args[0] = parse_name("input", argv[1], inputNames, REMAP_NUM_INPUTS, 1);
+    args[1] = strcasecmp(argv[2], "none") == 0 ? REMAP_NONE
+      : parse_name("output", argv[2], outputNames, sizeof(outputNames) / sizeof(outputNames[0]), 0);
+    return send_command(fd, TUNING_SET_REMAP, args, 2);
+  }
+  if (strcmp(command, "rate") == 0 && argc == 2)
+  {
+    unsigned long hz = strtoul(argv[1], NULL, 0);
+
+    for (args[0] = 0; args[0] < POLL_RATE_COUNT; ++args[0])
+    {
+      if (hz == 1000 / POLL_RATE_INTERVAL(args[0]))
+        return send_command(fd, TUNING_SET_POLL_RATE, args, 1);
+    }
+    fprintf(stderr, "pewtool: rate must be 1000, 500, 250 or 125 Hz\n");
+    exit(1);
+  }
+  if (strcmp(command, "save") == 0 && argc == 1)
+    return send_command(fd, TUNING_SAVE, args, 0);
+  if (strcmp(command, "defaults") == 0 && argc == 1)
+    return send_command(fd, TUNING_LOAD_DEFAULTS, args, 0);
+  return -1;
+}
+
+static void print_loop(int fd, unsigned count)
+{
+  static const char* const sources[] =
+    {"-", "USB_GEN_vect", "USB_COM_vect", "TIMER1_COMPA_vect", "timer.c", "loop_monitor.c",
+     "tuning.c"};
+  uint8_t report[REPORT_BUFFER_SIZE];
+  uint8_t lastPassFrame = 0;
+  uint32_t lastPasses = 0;
+  unsigned lines = 0;
+
+  printf("%7s %11s %9s %9s %16s %28s\n", "frames", "passes/frm", "min/frm", "max/frm",
+         "longest pass", "longest interrupts off");
+  while (count == 0 || lines < count)
+  {
+    read_report(fd, LOOP_REPORT_ID, report, LOOP_REPORT_SIZE);
+    unsigned usPerTick = report[1];
+    unsigned frames = get_le(report + 2, 2);
+    uint32_t passes = get_le(report + 4, 4);
+
+    // A window is only printed once; the device keeps returning the last
+    // complete one until the next closes.
+    if (frames && (passes != lastPasses || report[14] != lastPassFrame))
+    {
+      unsigned source = report[18];
+
+      printf("%7u %11.1f %9u %9u %8u us @%3u %8u us @%3u %s\n", frames, (double)passes / frames,
+             (unsigned)get_le(report + 8, 2), (unsigned)get_le(report + 10, 2),
+             (unsigned)get_le(report + 12, 2) * usPerTick, report[14],
+             (unsigned)get_le(report + 15, 2) * usPerTick, report[17],
+             source < sizeof(sources) / sizeof(sources[0]) ? sources[source] : "?");
+      fflush(stdout);
+      lastPasses = passes;
+      lastPassFrame = report[14];
+      ++lines;
+    }
+    usleep(LOOP_WINDOW_FRAMES * 1000 / 4);
+  }
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "usage: pewtool device command\n"
+          "  loop [count]  main loop and interrupt load per %u frame window\n"
+          "                (count windows, default until interrupted)\n"
+          "  latency       input latency histograms\n"
+          "  boot          boot timing\n"
+          "  filter        switch bounce and debounce windows\n"
+          "  config        settings in use\n"
+          "  window INPUT US\n"
+          "                debounce window of an input (B_01, D_UP, ... or all)\n"
+          "  mode PRESS RELEASE [adaptive|fixed]\n"
+          "                filter modes (debounced or eager) and window adaptation\n"
+          "  remap INPUT OUTPUT\n"
+          "                USB output of an input (BUTTON_01-12, LEFT, RIGHT, UP,\n"
+          "                DOWN or NONE)\n"
+          "  rate HZ       report rate, and polling rate from the next power-on\n"
+          "  save          keep the settings across a reset\n"
+          "  defaults      go back to the default settings, without saving\n",
+          LOOP_WINDOW_FRAMES);
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  int fd;
+  int result = 0;
+
+  if (argc < 3)
+    usage();
+  devicePath = argv[1];
+  fd = open(devicePath, O_RDWR);
+  if (fd < 0)
+  {
+    perror(devicePath);
+    return 1;
+  }
+
+  if (strcmp(argv[2], "loop") == 0 && argc <= 4)
+    print_loop(fd, argc == 4 ? strtoul(argv[3], NULL, 0) : 0);
+  else if (strcmp(argv[2], "latency") == 0 && argc == 3)
+    print_latency(fd);
+  else if (strcmp(argv[2], "boot") == 0 && argc == 3)
+    print_boot(fd);
+  else if (strcmp(argv[2], "filter") == 0 && argc == 3)
+    print_filter(fd);
+  else if (strcmp(argv[2], "config") == 0 && argc == 3)
+    print_config(fd);
+  else if ((result = tune(fd, argc - 2, argv + 2)) < 0)
+    usage();
+
+  close(fd);
+  return result;
+}
@@ -0,0 +1,1411 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Firmware simulation bench, built and run with "make sim".  The real
+// main() from pew_pew_stick.c runs against a model of the ATmega32U4's
+// USB device controller, Timer1 and the pin change and external
+// interrupts, while a scripted USB host enumerates the device, polls the
+// gamepad endpoint and presses a button.  It reports how long enumeration
+// took, how soon after SET_CONFIGURATION the first report is read, how
+// many frames pass between an edge on a port pin and the IN report that
+// carries it, and the longest stretch with interrupts disabled.  Every
+// report that carries an edge must change exactly the button's fields
+// of the profile's report, or the run fails.  The firmware's own latency
+// histograms and main loop counters are read back at the end.
+//
+// With -r the host replays a script made by trace2replay from a captured
+// enumeration instead, keeping the capture's pauses between requests.
+// Every request is then checked against what the captured device did: it
+// has to return as many bytes, or stall, and finish within the time the
+// captured device took.  -P picks the profile the firmware enumerates as.
+// -R holds the button that selects a polling rate down at power-on and
+// lets go of it once the device is configured.  -b makes the button
+// bounce for a while after every edge, and the firmware's bounce
+// statistics for it are printed at the end.  -w and -T send tuning
+// commands that change every debounce window and the polling rate once
+// the device is enumerated.
+//
+// Time is simulated, so every run gives the same numbers.  It is not
+// cycle-accurate: the firmware runs natively and the clock only advances
+// on register accesses (a fixed cost each, set with -c) and on interrupt
+// entry.  That is close enough to compare scheduling changes, not to
+// count instructions.
+
+#include <ctype.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "host_io.h"
+#include "../pins.h"
+#include "../usb_gamepad.h"
+#include "../usb_profiles.h"
+#include "../latency_stats.h"
+#include "../loop_monitor.h"
+#include "../input_filter.h"
+#include "../tuning.h"
+#include "../poll_rate.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000UL)
+#define US(us) ((uint64_t)(us) * CYCLES_PER_US)
+
+// Cost model: cycles per register access, and for entering and leaving
+// an interrupt handler (vector jump, prologue, epilogue and reti).
+#define DEFAULT_ACCESS_CYCLES 6
+#define ISR_CYCLES 40
+
+// Host timing.  The host resets the bus shortly after the device
+// attaches, retries NAKed control transactions every HOST_RETRY_US and
+// starts the next request HOST_REQUEST_GAP_US after the last one ends,
+// or TUNING_COMMAND_GAP_US for a tuning command that follows another.
+#define HOST_RESET_DELAY_US 1000
+#define HOST_RETRY_US 5
+#define HOST_REQUEST_GAP_US 10
+#define TUNING_COMMAND_GAP_US 1000
+
+// Size of the output report sent before the tuning commands, the PS3's
+// LED and rumble report, which takes two 32-byte control packets.
+#define OUTPUT_REPORT_SIZE 48
+#define DEFAULT_POLL_PHASE_US 250
+
+// Input script: the button is toggled DEFAULT_EDGES times, the edges
+// EDGE_SPACING_US apart plus up to a frame of jitter, starting
+// EDGE_SETTLE_US after the device is configured.
+#define DEFAULT_EDGES 32
+#define EDGE_SPACING_US 20000
+#define EDGE_SETTLE_US 50000
+#define EDGE_PIN (1<<3)
+#define BOUNCE_FLIP_US 300
+#define SIM_TIMEOUT_US 10000000
+
+#define NUM_ENDPOINTS 7
+#define NEVER UINT64_MAX
+
+// Interrupt handlers of the firmware.  INT0-3 are aliases of the pin
+// change handler on the target, so they are delivered to it here.
+void PCINT0_vect(void);
+void USB_GEN_vect(void);
+void USB_COM_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_OVF_vect(void);
+
+// The firmware's main(), renamed when pew_pew_stick.c is built for the
+// bench.  It starts USB through sim_usb_init() so the profile can be
+// picked here.
+int firmware_main(void);
+void sim_usb_init(Profile profile, uint8_t interval);
+
+struct SimEndpoint
+{
+  uint8_t conx;
+  uint8_t cfg0;
+  uint8_t cfg1;
+  uint8_t ienx;
+  uint8_t intx;
+  uint8_t busy;
+  uint8_t length;
+  uint8_t position;
+  uint8_t data[64];
+};
+
+enum ControlStage
+{
+  STAGE_SETUP,
+  STAGE_DATA_IN,
+  STAGE_DATA_OUT,
+  STAGE_STATUS_IN,
+  STAGE_STATUS_OUT
+};
+
+// A step of the host's script.  The next three are only used when
+// replaying a capture: the pause before the request, and the time the
+// captured device took and the number of bytes it returned (-1 if not
+// checked).  The last is the data stage of an OUT request, zero-padded.
+struct HostRequest
+{
+  const char* name;
+  uint8_t reset;
+  uint8_t setup[8];
+  uint32_t gapUs;
+  uint32_t budgetUs;
+  int length;
+  uint8_t data[8];
+};
+
+#define SETUP(type, request, value, index, length) \
+  {type, request, (value) & 0xFF, (value) >> 8, (index) & 0xFF, (index) >> 8, \
+   (length) & 0xFF, (length) >> 8}
+
+// What a Linux host sends to a new HID device.
+static const struct HostRequest enumeration[] =
+{
+  {"bus reset", 1, SETUP(0, 0, 0, 0, 0)},
+  {"GET_DESCRIPTOR device", 0, SETUP(0x80, 6, 0x0100, 0, 64)},
+  {"bus reset", 1, SETUP(0, 0, 0, 0, 0)},
+  {"SET_ADDRESS", 0, SETUP(0x00, 5, 1, 0, 0)},
+  {"GET_DESCRIPTOR device", 0, SETUP(0x80, 6, 0x0100, 0, 18)},
+  {"GET_DESCRIPTOR config", 0, SETUP(0x80, 6, 0x0200, 0, 9)},
+  {"GET_DESCRIPTOR config", 0, SETUP(0x80, 6, 0x0200, 0, 255)},
+  {"GET_DESCRIPTOR string 0", 0, SETUP(0x80, 6, 0x0300, 0, 255)},
+  {"GET_DESCRIPTOR string 2", 0, SETUP(0x80, 6, 0x0302, 0x0409, 255)},
+  {"GET_DESCRIPTOR string 1", 0, SETUP(0x80, 6, 0x0301, 0x0409, 255)},
+  {"SET_CONFIGURATION", 0, SETUP(0x00, 9, 1, 0, 0)},
+  {"SET_IDLE", 0, SETUP(0x21, 10, 0, 0, 0)},
+  {"GET_DESCRIPTOR report", 0, SETUP(0x81, 6, 0x2200, 0, 255)}
+};
+#define NUM_REQUESTS (sizeof(enumeration) / sizeof(enumeration[0]))
+
+// With -w or -T, the enumeration followed by tuning commands that set the
+// window of every input or the polling rate, each followed by a read of
+// the settings.
+static struct HostRequest tunedEnumeration[NUM_REQUESTS + 6];
+
+static const struct HostRequest* requests = enumeration;
+static unsigned numRequests = NUM_REQUESTS;
+static int replaying;
+static Profile profile = SP_PC;
+static unsigned bootRateHz;
+
+static uint32_t accessCycles = DEFAULT_ACCESS_CYCLES;
+static uint32_t pollPhaseUs = DEFAULT_POLL_PHASE_US;
+static uint32_t edgeCount = DEFAULT_EDGES;
+static uint32_t bounceUs;
+static long tunedWindowUs = -1;
+static unsigned tunedRateHz;
+static int verbose = 0;
+
+static jmp_buf simExit;
+static uint64_t now;
+
+// Registers whose writes have side effects are handed to the firmware
+// through a scratch byte.  The write is picked up at the next register
+// access, by comparing the scratch byte against what was loaded into it.
+// Flag registers that are cleared by writing a one read back as zero,
+// since the firmware only ever writes them.
+static struct
+{
+  int active;
+  enum HostReg8 reg;
+  uint8_t endpoint;
+  uint8_t loaded;
+  volatile uint8_t value;
+} pending;
+
+static volatile uint8_t readOnly;
+static struct SimEndpoint endpoints[NUM_ENDPOINTS];
+static uint16_t frameNumber;
+static uint16_t lastTcnt;
+static const char* isrName;
+
+// Interrupts-disabled tracking.  The window before the first sei() is
+// start-up and not counted.
+static int interruptsSeen;
+static uint64_t disabledSince;
+static const char* disabledIn;
+static uint64_t worstDisabled;
+static const char* worstDisabledIn;
+
+// USB host state
+static uint64_t attachAt = NEVER;
+static uint64_t nextSof = NEVER;
+static uint64_t nextHostAt = NEVER;
+static uint64_t nextPollAt = NEVER;
+static uint64_t nextEdgeAt = NEVER;
+static uint64_t nextBounceAt = NEVER;
+static unsigned requestIndex;
+static enum ControlStage stage;
+static uint64_t requestStart;
+static uint16_t requestLength;
+static uint16_t responseLength;
+static uint16_t sentLength;
+static uint8_t response[256];
+static uint8_t pollInterval = 1;
+static int configured;
+
+// Results
+static uint64_t enumerationStart;
+static uint64_t enumerationTime;
+static uint64_t configuredAt = NEVER;
+static uint64_t firstReportAt = NEVER;
+static uint64_t slowestRequest;
+static const char* slowestRequestName;
+static unsigned stalls;
+static unsigned overBudget;
+static uint64_t replayRequestTime;
+static unsigned wrongLength;
+static unsigned reports;
+static uint8_t lastReport[64];
+static uint8_t lastReportLength;
+
+// Report fields driven by the button on EDGE_PIN (button 1: square on a
+// PS3, X on an X360), as byte offset and mask, in each profile.  A mask
+// of 0 ends the list.
+struct ReportField
+{
+  uint8_t byte;
+  uint8_t mask;
+};
+static const struct ReportField edgeFields[][2] =
+{
+  [SP_PC] = {{2, 0x01}},
+  [SP_PS3] = {{3, 0x80}, {25, 0xFF}},
+  [SP_X360] = {{3, 0x40}}
+};
+
+static uint32_t rng = 12345;
+static unsigned edgesSent;
+static unsigned edgesSeen;
+static uint64_t edgeAt;
+static uint64_t bounceEnd;
+static uint16_t edgeFrame;
+static uint64_t latencyMin = NEVER;
+static uint64_t latencyMax;
+static uint64_t latencyTotal;
+static unsigned framesMin = 0xFFFF;
+static unsigned framesMax;
+
+static double to_us(uint64_t cycles)
+{
+  return (double)cycles / CYCLES_PER_US;
+}
+
+static uint32_t next_random(void)
+{
+  rng = rng * 1103515245UL + 12345;
+  return rng >> 8;
+}
+
+// The input filter lives on the firmware's stack, so its reports are
+// taken before leaving it.
+static uint8_t filterReports[NUM_CONTROLLER_STATE_BYTES][INPUT_FILTER_REPORT_SIZE];
+
+static void finish(void)
+{
+  for (unsigned byte = 0; byte < NUM_CONTROLLER_STATE_BYTES; ++byte)
+    write_input_filter_report(byte, FILTER_REPORT_ID(byte), filterReports[byte]);
+  longjmp(simExit, 1);
+}
+
+static void fail(const char* why)
+{
+  fprintf(stderr, "sim: %s at %.1f us\n", why, to_us(now));
+  exit(1);
+}
+
+// Fails unless a report read after an edge differs from the last one in
+// exactly the fields of the button, which are set while it is pressed.
+// The first edge is a press.
+static void check_edge_report(const uint8_t* report, uint8_t length)
+{
+  uint8_t pressed = !(edgesSeen & 1);
+
+  for (unsigned i = 0; i < length; ++i)
+  {
+    uint8_t mask = 0;
+    uint8_t expected;
+
+    for (unsigned f = 0; f < 2; ++f)
+    {
+      if (edgeFields[profile][f].mask && edgeFields[profile][f].byte == i)
+        mask = edgeFields[profile][f].mask;
+    }
+    expected = (lastReport[i] & ~mask) | (pressed ? mask : 0);
+    if (report[i] != expected)
+    {
+      char why[80];
+
+      snprintf(why, sizeof(why), "edge %u: report byte %u is 0x%02X, expected 0x%02X",
+               edgesSeen, i, report[i], expected);
+      fail(why);
+    }
+  }
+}
+
+//
+// Interrupt enable tracking
+//
+
+static void interrupts_changed(uint8_t before, uint8_t after)
+{
+  if ((before & SREG_I) && !(after & SREG_I))
+  {
+    disabledSince = now;
+    disabledIn = isrName ? isrName : "main loop";
+  }
+  else if (!(before & SREG_I) && (after & SREG_I))
+  {
+    if (interruptsSeen && now - disabledSince > worstDisabled)
+    {
+      worstDisabled = now - disabledSince;
+      worstDisabledIn = disabledIn;
+    }
+    interruptsSeen = 1;
+  }
+}
+
+//
+// USB device controller
+//
+
+static void reset_endpoint_bank(uint8_t ep)
+{
+  struct SimEndpoint* endpoint = &endpoints[ep];
+
+  endpoint->busy = 0;
+  endpoint->length = 0;
+  endpoint->position = 0;
+  if (ep == 0)
+    endpoint->intx = (1<<TXINI);
+  else if (endpoint->cfg0 & (1<<EPDIR))
+    endpoint->intx = (1<<TXINI) | (1<<FIFOCON) | (1<<RWAL);
+  else
+    endpoint->intx = 0;
+}
+
+static uint8_t endpoint_interrupts(void)
+{
+  uint8_t bits = 0;
+
+  for (uint8_t ep = 0; ep < NUM_ENDPOINTS; ++ep)
+  {
+    if (endpoints[ep].intx & endpoints[ep].ienx & 0x5F)
+      bits |= (1 << ep);
+  }
+  return bits;
+}
+
+static void write_uerst(uint8_t value)
+{
+  for (uint8_t ep = 0; ep < NUM_ENDPOINTS; ++ep)
+  {
+    if ((value & (1 << ep)) && (endpoints[ep].cfg1 & (1<<ALLOC)))
+      reset_endpoint_bank(ep);
+  }
+}
+
+static void write_ueintx(uint8_t ep, uint8_t value)
+{
+  struct SimEndpoint* endpoint = &endpoints[ep];
+  uint8_t before = endpoint->intx;
+  uint8_t cleared;
+
+  // Every flag but RWAL is cleared by writing a zero to it.
+  endpoint->intx &= value | (1<<RWAL);
+  cleared = before & ~endpoint->intx;
+
+  if (ep == 0)
+  {
+    if (before & ((1<<RXSTPI) | (1<<RXOUTI)))
+    {
+      // Acknowledging a received packet frees the bank.  Clearing TXINI
+      // at the same time does not send anything.
+      if (cleared & ((1<<RXSTPI) | (1<<RXOUTI)))
+      {
+        endpoint->length = 0;
+        endpoint->position = 0;
+      }
+      endpoint->intx |= before & (1<<TXINI);
+    }
+    else if (cleared & (1<<TXINI))
+    {
+      endpoint->length = endpoint->position;
+      endpoint->busy = 1;
+    }
+  }
+  else if (cleared & (1<<FIFOCON))
+  {
+    endpoint->length = endpoint->position;
+    endpoint->busy = 1;
+    endpoint->intx &= ~((1<<TXINI) | (1<<RWAL));
+  }
+}
+
+static void write_ueconx(uint8_t ep, uint8_t value)
+{
+  struct SimEndpoint* endpoint = &endpoints[ep];
+
+  if (value & (1<<STALLRQC))
+    endpoint->conx &= ~(1<<STALLRQ);
+  endpoint->conx = (endpoint->conx & (1<<STALLRQ)) | (value & ((1<<STALLRQ) | (1<<EPEN)));
+}
+
+static void write_uecfg1x(uint8_t ep, uint8_t value)
+{
+  endpoints[ep].cfg1 = value;
+  if (value & (1<<ALLOC))
+    reset_endpoint_bank(ep);
+}
+
+static void apply_write(enum HostReg8 reg, uint8_t ep, uint8_t value)
+{
+  uint8_t before;
+
+  switch (reg)
+  {
+    case HOST_SREG:
+      before = host_reg8_storage[HOST_SREG];
+      host_reg8_storage[HOST_SREG] = value;
+      interrupts_changed(before, value);
+      break;
+    case HOST_UDINT:
+      host_reg8_storage[HOST_UDINT] &= value;
+      break;
+    case HOST_TIFR1:
+    case HOST_PCIFR:
+    case HOST_EIFR:
+      host_reg8_storage[reg] &= ~value;
+      break;
+    case HOST_UEINTX:
+      write_ueintx(ep, value);
+      break;
+    case HOST_UECONX:
+      write_ueconx(ep, value);
+      break;
+    case HOST_UECFG0X:
+      endpoints[ep].cfg0 = value;
+      break;
+    case HOST_UECFG1X:
+      write_uecfg1x(ep, value);
+      break;
+    case HOST_UERST:
+      write_uerst(value);
+      break;
+    default:
+      break;
+  }
+}
+
+static void resolve_pending(void)
+{
+  if (pending.active)
+  {
+    pending.active = 0;
+    if (pending.value != pending.loaded)
+      apply_write(pending.reg, pending.endpoint, pending.value);
+  }
+}
+
+static volatile uint8_t* defer(enum HostReg8 reg, uint8_t ep, uint8_t loaded)
+{
+  pending.active = 1;
+  pending.reg = reg;
+  pending.endpoint = ep;
+  pending.loaded = loaded;
+  pending.value = loaded;
+  return &pending.value;
+}
+
+// Packet size the firmware configured endpoint 0 with.
+static uint8_t ep0_size(void)
+{
+  return 8 << ((endpoints[0].cfg1 >> 4) & 0x07);
+}
+
+static volatile uint8_t* endpoint_data(uint8_t ep)
+{
+  struct SimEndpoint* endpoint = &endpoints[ep];
+  uint8_t size = ep == 0 ? ep0_size() : sizeof(endpoint->data);
+
+  // Received packets are read out, anything else is a packet being
+  // written for the host.
+  if (endpoint->intx & ((1<<RXSTPI) | (1<<RXOUTI)))
+  {
+    if (endpoint->position < endpoint->length)
+      return &endpoint->data[endpoint->position++];
+    readOnly = 0;
+    return &readOnly;
+  }
+  if (endpoint->position < size)
+    return &endpoint->data[endpoint->position++];
+  return &readOnly;
+}
+
+//
+// USB host
+//
+
+static void release_boot_button(void);
+
+static void start_frame(void)
+{
+  frameNumber = (frameNumber + 1) & 0x7FF;
+  host_reg8_storage[HOST_UDINT] |= (1<<SOFI);
+  nextSof += US(1000);
+  if (configured && frameNumber % pollInterval == 0)
+    nextPollAt = now + US(pollPhaseUs);
+}
+
+static void bus_reset(void)
+{
+  memset(endpoints, 0, sizeof(endpoints));
+  host_reg8_storage[HOST_UDADDR] = 0;
+  host_reg8_storage[HOST_UDINT] |= (1<<EORSTI);
+  configured = 0;
+  nextPollAt = NEVER;
+  if (nextSof == NEVER)
+    nextSof = now + US(1000);
+}
+
+static void parse_configuration(void)
+{
+  // Poll at the gamepad endpoint's bInterval, rounded down to a power of
+  // two as hosts do.
+  for (uint16_t i = 0; i + 1 < responseLength && response[i]; i += response[i])
+  {
+    if (response[i + 1] == 5 && i + 6 < responseLength && response[i + 2] == 0x81)
+    {
+      pollInterval = 1;
+      while (pollInterval * 2 <= response[i + 6] && pollInterval < 32)
+        pollInterval *= 2;
+    }
+  }
+}
+
+static void start_request(void)
+{
+  const struct HostRequest* request = &requests[requestIndex];
+  struct SimEndpoint* ep0 = &endpoints[0];
+
+  requestStart = now;
+  if (request->reset)
+  {
+    bus_reset();
+    stage = STAGE_STATUS_OUT;
+    nextHostAt = now + US(HOST_REQUEST_GAP_US);
+    return;
+  }
+
+  // A SETUP packet is always accepted and cancels a stall.
+  memcpy(ep0->data, request->setup, 8);
+  ep0->length = 8;
+  ep0->position = 0;
+  ep0->busy = 0;
+  ep0->conx &= ~(1<<STALLRQ);
+  ep0->intx |= (1<<RXSTPI);
+  requestLength = request->setup[6] | (request->setup[7] << 8);
+  responseLength = 0;
+  sentLength = 0;
+  if (requestLength == 0)
+    stage = STAGE_STATUS_IN;
+  else if (request->setup[0] & 0x80)
+    stage = STAGE_DATA_IN;
+  else
+    stage = STAGE_DATA_OUT;
+  nextHostAt = now + US(HOST_RETRY_US);
+}
+
+static void end_request(int stalled)
+{
+  const struct HostRequest* request = &requests[requestIndex];
+  uint64_t elapsed = now - requestStart;
+  int length = stalled ? 0 : responseLength;
+
+  if (replaying && !request->reset)
+  {
+    int slow = elapsed > US(request->budgetUs);
+    int wrong = request->length >= 0 && length != request->length;
+
+    printf("%10.1f us  %-26s %8.1f us  of %8u  %3d bytes%s%s%s\n", to_us(now),
+           request->name, to_us(elapsed), request->budgetUs, length,
+           stalled ? "  STALL" : "", slow ? "  OVER BUDGET" : "",
+           wrong ? "  WRONG LENGTH" : "");
+    overBudget += slow;
+    wrongLength += wrong;
+    replayRequestTime += elapsed;
+  }
+  else if (verbose)
+  {
+    printf("%10.1f us  %-26s %8.1f us%s\n", to_us(now), request->name,
+           to_us(elapsed), stalled ? "  STALL" : "");
+  }
+  stalls += stalled;
+  if (!request->reset && elapsed > slowestRequest)
+  {
+    slowestRequest = elapsed;
+    slowestRequestName = request->name;
+  }
+  if (request->setup[1] == 6 && request->setup[3] == 1 && !stalled && responseLength > 7
+      && response[7] != ep0_size())
+    fail("bMaxPacketSize0 does not match the endpoint 0 size");
+  if (request->setup[1] == 6 && request->setup[3] == 2)
+    parse_configuration();
+  if (request->setup[1] == 9)
+  {
+    configured = 1;
+    if (configuredAt == NEVER)
+      configuredAt = now;
+    release_boot_button();
+  }
+
+  if (++requestIndex < numRequests)
+  {
+    uint32_t gapUs = requests[requestIndex].gapUs;
+
+    if (!replaying && gapUs < HOST_REQUEST_GAP_US)
+      gapUs = HOST_REQUEST_GAP_US;
+    nextHostAt = now + US(gapUs);
+    stage = STAGE_SETUP;
+  }
+  else
+  {
+    nextHostAt = NEVER;
+    enumerationTime = now - enumerationStart;
+    nextEdgeAt = now + US(EDGE_SETTLE_US);
+  }
+}
+
+// One control transaction on endpoint 0.
+static void host_control(void)
+{
+  struct SimEndpoint* ep0 = &endpoints[0];
+
+  nextHostAt = now + US(HOST_RETRY_US);
+  if (!enumerationStart)
+  {
+    // The device has attached; the script starts with a bus reset.
+    enumerationStart = now;
+    start_request();
+    return;
+  }
+  if (stage == STAGE_SETUP)
+  {
+    start_request();
+    return;
+  }
+  if (requests[requestIndex].reset)
+  {
+    end_request(0);
+    return;
+  }
+  if (ep0->conx & (1<<STALLRQ))
+  {
+    end_request(1);
+    return;
+  }
+
+  switch (stage)
+  {
+    case STAGE_DATA_IN:
+      if (!ep0->busy)
+        return;
+      memcpy(response + responseLength, ep0->data,
+             ep0->length < sizeof(response) - responseLength
+               ? ep0->length : sizeof(response) - responseLength);
+      responseLength += ep0->length;
+      if (ep0->length < ep0_size() || responseLength >= requestLength)
+        stage = STAGE_STATUS_OUT;
+      ep0->busy = 0;
+      ep0->position = 0;
+      ep0->intx |= (1<<TXINI);
+      break;
+    case STAGE_DATA_OUT:
+      // OUT packets are NAKed until the bank is free.
+      if (ep0->intx & ((1<<RXSTPI) | (1<<RXOUTI)))
+        return;
+      // The script's data goes in the first packet; any packets after
+      // it are zeros.
+      memset(ep0->data, 0, sizeof(ep0->data));
+      if (sentLength == 0)
+        memcpy(ep0->data, requests[requestIndex].data, sizeof(requests[requestIndex].data));
+      ep0->length = requestLength - sentLength < ep0_size() ? requestLength - sentLength : ep0_size();
+      ep0->position = 0;
+      ep0->intx |= (1<<RXOUTI);
+      sentLength += ep0->length;
+      if (sentLength >= requestLength)
+        stage = STAGE_STATUS_IN;
+      break;
+    case STAGE_STATUS_IN:
+      if (!ep0->busy)
+        return;
+      ep0->busy = 0;
+      ep0->position = 0;
+      ep0->intx |= (1<<TXINI);
+      end_request(0);
+      break;
+    case STAGE_STATUS_OUT:
+      if (ep0->intx & ((1<<RXSTPI) | (1<<RXOUTI)))
+        return;
+      ep0->length = 0;
+      ep0->position = 0;
+      ep0->intx |= (1<<RXOUTI);
+      end_request(0);
+      break;
+    default:
+      break;
+  }
+}
+
+// The host's IN token for the gamepad endpoint.
+static void host_poll(void)
+{
+  struct SimEndpoint* endpoint = &endpoints[GAMEPAD_ENDPOINT_IN];
+
+  nextPollAt = NEVER;
+  if (!(endpoint->cfg1 & (1<<ALLOC)) || !endpoint->busy)
+  {
+    endpoint->intx |= (1<<NAKINI);
+    return;
+  }
+
+  ++reports;
+  if (firstReportAt == NEVER)
+    firstReportAt = now;
+  if (edgesSeen < edgesSent && lastReportLength == endpoint->length
+      && memcmp(lastReport, endpoint->data, endpoint->length) != 0)
+  {
+    uint64_t latency = now - edgeAt;
+    unsigned frames = (frameNumber - edgeFrame) & 0x7FF;
+
+    check_edge_report(endpoint->data, endpoint->length);
+    if (latency < latencyMin) latencyMin = latency;
+    if (latency > latencyMax) latencyMax = latency;
+    if (frames < framesMin) framesMin = frames;
+    if (frames > framesMax) framesMax = frames;
+    latencyTotal += latency;
+    if (verbose)
+      printf("%10.1f us  edge %-21u %8.1f us  %u frames\n", to_us(now), edgesSeen, to_us(latency), frames);
+    if (++edgesSeen == edgeCount)
+      finish();
+  }
+  memcpy(lastReport, endpoint->data, endpoint->length);
+  lastReportLength = endpoint->length;
+
+  endpoint->busy = 0;
+  endpoint->position = 0;
+  endpoint->intx |= (1<<TXINI) | (1<<FIFOCON) | (1<<RWAL);
+}
+
+//
+// Port pins
+//
+
+static void set_pin_b(uint8_t value)
+{
+  uint8_t changed = host_reg8_storage[HOST_PINB] ^ value;
+
+  host_reg8_storage[HOST_PINB] = value;
+  if (changed & host_reg8_storage[HOST_PCMSK0])
+    host_reg8_storage[HOST_PCIFR] |= (1<<PCIF0);
+}
+
+// Pins of BUTTON_01-04, which pick 1000, 500, 250 and 125 Hz when held at
+// power-on.
+static void press_boot_button(int press)
+{
+  uint8_t level = press ? 0x00 : 0xFF;
+
+  switch (bootRateHz)
+  {
+  case 1000:
+    set_pin_b((host_reg8_storage[HOST_PINB] & ~(1<<3)) | (level & (1<<3)));
+    break;
+  case 500:
+    set_pin_b((host_reg8_storage[HOST_PINB] & ~(1<<7)) | (level & (1<<7)));
+    break;
+  case 250:
+    host_reg8_storage[HOST_PINC] = (host_reg8_storage[HOST_PINC] & ~(1<<6)) | (level & (1<<6));
+    break;
+  case 125:
+    host_reg8_storage[HOST_PINF] = (host_reg8_storage[HOST_PINF] & ~(1<<6)) | (level & (1<<6));
+    break;
+  }
+}
+
+static void release_boot_button(void)
+{
+  press_boot_button(0);
+}
+
+static void toggle_button(void)
+{
+  if (edgesSeen < edgesSent)
+  {
+    // The last edge has not been reported yet.
+    nextEdgeAt = now + US(1000);
+    return;
+  }
+  set_pin_b(host_reg8_storage[HOST_PINB] ^ EDGE_PIN);
+  edgeAt = now;
+  edgeFrame = frameNumber;
+  ++edgesSent;
+  nextEdgeAt = now + US(EDGE_SPACING_US) + next_random() % US(1000);
+  if (bounceUs)
+  {
+    bounceEnd = now + US(bounceUs);
+    nextBounceAt = now + 1 + next_random() % US(BOUNCE_FLIP_US);
+  }
+}
+
+// Appends the tuning requests for -w and -T to the enumeration script,
+// after a SET_REPORT without a data stage and one whose data takes more
+// than one packet, both of which the device has to acknowledge.
+static void add_tuning_requests(void)
+{
+  uint8_t rate = tunedRateHz == 500 ? POLL_RATE_500HZ : tunedRateHz == 250 ? POLL_RATE_250HZ
+               : tunedRateHz == 125 ? POLL_RATE_125HZ : POLL_RATE_1000HZ;
+  const struct HostRequest setEmpty =
+    {"SET_REPORT empty", 0,
+     SETUP(0x21, 9, 0x0300 | TUNING_COMMAND_REPORT_ID, GAMEPAD_INTERFACE, 0)};
+  const struct HostRequest setOutput =
+    {"SET_REPORT output", 0,
+     SETUP(0x21, 9, 0x0201, GAMEPAD_INTERFACE, OUTPUT_REPORT_SIZE)};
+  const struct HostRequest setWindow =
+    {"SET_REPORT tuning", 0,
+     SETUP(0x21, 9, 0x0300 | TUNING_COMMAND_REPORT_ID, GAMEPAD_INTERFACE, TUNING_COMMAND_SIZE),
+     0, 0, 0,
+     {TUNING_COMMAND_REPORT_ID, 1, TUNING_SET_WINDOW, TUNING_ALL_INPUTS,
+      tunedWindowUs & 0xFF, tunedWindowUs >> 8}};
+  // Setting every window keeps the main loop busy for a while, and the
+  // device stalls a command that arrives before it has applied the last.
+  const struct HostRequest setRate =
+    {"SET_REPORT tuning", 0,
+     SETUP(0x21, 9, 0x0300 | TUNING_COMMAND_REPORT_ID, GAMEPAD_INTERFACE, TUNING_COMMAND_SIZE),
+     tunedWindowUs >= 0 ? TUNING_COMMAND_GAP_US : 0, 0, 0,
+     {TUNING_COMMAND_REPORT_ID, 2, TUNING_SET_POLL_RATE, rate}};
+  const struct HostRequest getSettings =
+    {"GET_REPORT tuning", 0,
+     SETUP(0xA1, 1, 0x0300 | TUNING_REPORT_ID, GAMEPAD_INTERFACE, TUNING_REPORT_SIZE)};
+
+  memcpy(tunedEnumeration, enumeration, sizeof(enumeration));
+  numRequests = NUM_REQUESTS;
+  tunedEnumeration[numRequests++] = setEmpty;
+  tunedEnumeration[numRequests++] = setOutput;
+  if (tunedWindowUs >= 0)
+  {
+    tunedEnumeration[numRequests++] = setWindow;
+    tunedEnumeration[numRequests++] = getSettings;
+  }
+  if (tunedRateHz)
+  {
+    tunedEnumeration[numRequests++] = setRate;
+    tunedEnumeration[numRequests++] = getSettings;
+  }
+  requests = tunedEnumeration;
+}
+
+// Flips the button back and forth at random until the bounce time is up,
+// then leaves it at the level of the last edge.
+static void bounce_button(void)
+{
+  uint8_t pin = host_reg8_storage[HOST_PINB];
+  uint8_t level = (edgesSent & 1) ? 0 : EDGE_PIN;
+
+  if (now >= bounceEnd)
+  {
+    set_pin_b((pin & ~EDGE_PIN) | level);
+    nextBounceAt = NEVER;
+    return;
+  }
+  set_pin_b(pin ^ EDGE_PIN);
+  nextBounceAt = now + 1 + next_random() % US(BOUNCE_FLIP_US);
+  if (nextBounceAt > bounceEnd)
+    nextBounceAt = bounceEnd;
+}
+
+//
+// Simulated time
+//
+
+static void update_timer(void)
+{
+  uint8_t clock = host_reg8_storage[HOST_TCCR1B] & 0x07;
+  uint16_t tcnt;
+  uint16_t ocr;
+
+  // Only the clk/64 prescaler used by timer.c is modelled.
+  if (clock != ((1<<CS11) | (1<<CS10)))
+    return;
+  tcnt = (uint16_t)(now / 64);
+  ocr = host_reg16_storage[HOST_OCR1A];
+  if ((uint16_t)(ocr - lastTcnt - 1) < (uint16_t)(tcnt - lastTcnt))
+    host_reg8_storage[HOST_TIFR1] |= (1<<OCF1A);
+  if (tcnt < lastTcnt)
+    host_reg8_storage[HOST_TIFR1] |= (1<<TOV1);
+  lastTcnt = tcnt;
+  host_reg16_storage[HOST_TCNT1] = tcnt;
+}
+
+static void run_events(void)
+{
+  for (;;)
+  {
+    uint64_t next = nextSof;
+
+    if (nextHostAt < next) next = nextHostAt;
+    if (nextPollAt < next) next = nextPollAt;
+    if (nextEdgeAt < next) next = nextEdgeAt;
+    if (nextBounceAt < next) next = nextBounceAt;
+    if (next > now)
+      return;
+
+    if (next == nextSof)
+      start_frame();
+    else if (next == nextPollAt)
+      host_poll();
+    else if (next == nextHostAt)
+      host_control();
+    else if (next == nextBounceAt)
+      bounce_button();
+    else
+      toggle_button();
+  }
+}
+
+static void deliver(void (*vector)(void), const char* name)
+{
+  uint8_t sreg = host_reg8_storage[HOST_SREG];
+
+  isrName = name;
+  host_reg8_storage[HOST_SREG] = sreg & ~SREG_I;
+  interrupts_changed(sreg, sreg & ~SREG_I);
+  now += ISR_CYCLES / 2;
+  vector();
+  resolve_pending();
+  now += ISR_CYCLES / 2;
+  isrName = NULL;
+  sreg = host_reg8_storage[HOST_SREG];
+  host_reg8_storage[HOST_SREG] = sreg | SREG_I;
+  interrupts_changed(sreg, sreg | SREG_I);
+}
+
+// Takes at most one interrupt, in the target's vector priority order.
+static void poll_interrupts(void)
+{
+  volatile uint8_t* reg = host_reg8_storage;
+
+  if (isrName || !(reg[HOST_SREG] & SREG_I))
+    return;
+
+  if (reg[HOST_EIFR] & reg[HOST_EIMSK] & 0x0F)
+  {
+    reg[HOST_EIFR] &= ~(reg[HOST_EIFR] & reg[HOST_EIMSK] & 0x0F);
+    deliver(PCINT0_vect, "PCINT0_vect");
+  }
+  else if (reg[HOST_PCIFR] & reg[HOST_PCICR] & (1<<PCIF0))
+  {
+    reg[HOST_PCIFR] &= ~(1<<PCIF0);
+    deliver(PCINT0_vect, "PCINT0_vect");
+  }
+  else if (reg[HOST_UDINT] & reg[HOST_UDIEN])
+  {
+    deliver(USB_GEN_vect, "USB_GEN_vect");
+  }
+  else if (endpoint_interrupts())
+  {
+    deliver(USB_COM_vect, "USB_COM_vect");
+  }
+  else if (reg[HOST_TIFR1] & reg[HOST_TIMSK1] & (1<<OCF1A))
+  {
+    reg[HOST_TIFR1] &= ~(1<<OCF1A);
+    deliver(TIMER1_COMPA_vect, "TIMER1_COMPA_vect");
+  }
+  else if (reg[HOST_TIFR1] & reg[HOST_TIMSK1] & (1<<TOV1))
+  {
+    reg[HOST_TIFR1] &= ~(1<<TOV1);
+    deliver(TIMER1_OVF_vect, "TIMER1_OVF_vect");
+  }
+}
+
+static void step(uint32_t cycles)
+{
+  resolve_pending();
+  now += cycles;
+  if (now > US(SIM_TIMEOUT_US))
+    fail(configured ? "timed out waiting for reports" : "timed out during enumeration");
+  if (attachAt == NEVER && !(host_reg8_storage[HOST_UDCON] & (1<<DETACH))
+      && (host_reg8_storage[HOST_USBCON] & (1<<USBE)))
+  {
+    attachAt = now;
+    nextHostAt = now + US(HOST_RESET_DELAY_US);
+  }
+  update_timer();
+  run_events();
+  poll_interrupts();
+}
+
+//
+// Register hooks
+//
+
+static volatile uint8_t* sim_reg8(enum HostReg8 reg)
+{
+  volatile uint8_t* storage = host_reg8_storage;
+  uint8_t ep;
+
+  step(accessCycles);
+  ep = storage[HOST_UENUM] & 0x07;
+  switch (reg)
+  {
+    case HOST_SREG:
+    case HOST_UDINT:
+    case HOST_UERST:
+      return defer(reg, 0, reg == HOST_UERST ? 0 : storage[reg]);
+    case HOST_TIFR1:
+      // Flags read as 0 so that writing a set flag back clears it,
+      // except TOV1, which timer_now_long() reads and nothing writes.
+      return defer(reg, 0, storage[reg] & (1<<TOV1));
+    case HOST_PCIFR:
+    case HOST_EIFR:
+      return defer(reg, 0, 0);
+    case HOST_PLLCSR:
+      if (storage[reg] & (1<<PLLE))
+        storage[reg] |= (1<<PLOCK);
+      return &storage[reg];
+    case HOST_UDFNUML:
+      storage[reg] = frameNumber & 0xFF;
+      return &storage[reg];
+    case HOST_UDFNUMH:
+      storage[reg] = frameNumber >> 8;
+      return &storage[reg];
+    case HOST_UEINT:
+      storage[reg] = endpoint_interrupts();
+      return &storage[reg];
+    case HOST_UEINTX:
+      return defer(reg, ep, endpoints[ep].intx);
+    case HOST_UECONX:
+      return defer(reg, ep, endpoints[ep].conx);
+    case HOST_UECFG0X:
+      return defer(reg, ep, endpoints[ep].cfg0);
+    case HOST_UECFG1X:
+      return defer(reg, ep, endpoints[ep].cfg1);
+    case HOST_UEIENX:
+      return &endpoints[ep].ienx;
+    case HOST_UEDATX:
+      return endpoint_data(ep);
+    case HOST_UEBCLX:
+      storage[reg] = endpoints[ep].intx & ((1<<RXSTPI) | (1<<RXOUTI))
+        ? endpoints[ep].length - endpoints[ep].position : endpoints[ep].position;
+      return &storage[reg];
+    default:
+      return &storage[reg];
+  }
+}
+
+static volatile uint16_t* sim_reg16(enum HostReg16 reg)
+{
+  step(accessCycles);
+  return &host_reg16_storage[reg];
+}
+
+void sim_usb_init(Profile firmwareProfile, uint8_t interval)
+{
+  usb_init(profile, interval);
+}
+
+//
+// Replay scripts
+//
+
+static void bad_script(const char* path, unsigned line)
+{
+  fprintf(stderr, "sim: %s:%u: not a replay step\n", path, line);
+  exit(1);
+}
+
+// Loads a script made by trace2replay, see there for the format.
+static void load_replay(const char* path)
+{
+  FILE* file = fopen(path, "r");
+  struct HostRequest* loaded = NULL;
+  unsigned count = 0;
+  unsigned lineNumber = 0;
+  char line[256];
+
+  if (!file)
+  {
+    perror(path);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), file))
+  {
+    struct HostRequest request;
+    unsigned type, bRequest, wValue, wIndex, wLength;
+    int nameAt = 0;
+
+    ++lineNumber;
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == '#' || line[strspn(line, " \t")] == 0)
+      continue;
+
+    memset(&request, 0, sizeof(request));
+    if (sscanf(line, "reset %u", &request.gapUs) == 1)
+    {
+      request.name = "bus reset";
+      request.reset = 1;
+    }
+    else if (sscanf(line, "control %u %u %d %x %x %x %x %u %n", &request.gapUs,
+                    &request.budgetUs, &request.length, &type, &bRequest, &wValue,
+                    &wIndex, &wLength, &nameAt) == 8 && nameAt)
+    {
+      const struct HostRequest parsed =
+        {NULL, 0, SETUP(type, bRequest, wValue, wIndex, wLength)};
+
+      memcpy(request.setup, parsed.setup, sizeof(request.setup));
+      request.name = strdup(line + nameAt);
+    }
+    else
+    {
+      bad_script(path, lineNumber);
+    }
+
+    loaded = realloc(loaded, (count + 1) * sizeof(*loaded));
+    if (!loaded)
+    {
+      perror("sim");
+      exit(1);
+    }
+    loaded[count++] = request;
+  }
+  fclose(file);
+
+  if (count == 0 || !loaded[0].reset)
+  {
+    fprintf(stderr, "sim: %s does not start with a bus reset\n", path);
+    exit(1);
+  }
+  requests = loaded;
+  numRequests = count;
+  replaying = 1;
+}
+
+static Profile parse_profile(const char* name)
+{
+  char lower[8];
+  unsigned i;
+
+  for (i = 0; name[i] && i + 1 < sizeof(lower); ++i)
+    lower[i] = tolower((unsigned char)name[i]);
+  lower[i] = 0;
+  if (strcmp(lower, "pc") == 0)
+    return SP_PC;
+  if (strcmp(lower, "ps3") == 0)
+    return SP_PS3;
+  if (strcmp(lower, "x360") == 0)
+    return SP_X360;
+  fprintf(stderr, "sim: unknown profile %s\n", name);
+  exit(1);
+}
+
+static uint32_t get_le(const uint8_t* p, unsigned size)
+{
+  uint32_t value = 0;
+
+  while (size--)
+    value = (value << 8) | p[size];
+  return value;
+}
+
+// Prints the firmware's latency histograms, decoded from the feature
+// reports the host would read.
+static void print_latency_reports(void)
+{
+  static const char* const names[LATENCY_STAGE_COUNT] =
+    {"filter", "publish", "handoff", "total"};
+  uint8_t report[LATENCY_REPORT_SIZE];
+
+  for (unsigned stage = 0; stage < LATENCY_STAGE_COUNT; ++stage)
+  {
+    write_latency_report(stage, LATENCY_REPORT_ID(stage), report);
+    unsigned usPerTick = report[1];
+    unsigned count = get_le(report + 2, 2);
+    printf("  %-17s %9.1f us  avg, %u min, %u max over %u changes\n", names[stage],
+           count ? (double)get_le(report + 8, 4) * usPerTick / count : 0.0,
+           (unsigned)get_le(report + 4, 2) * usPerTick,
+           (unsigned)get_le(report + 6, 2) * usPerTick, count);
+  }
+}
+
+// Prints the firmware's last main loop window, decoded from the feature
+// report.
+static void print_loop_report(void)
+{
+  static const char* const sources[] =
+    {"-", "USB_GEN_vect", "USB_COM_vect", "TIMER1_COMPA_vect", "timer.c", "loop_monitor.c",
+     "tuning.c"};
+  uint8_t report[LOOP_REPORT_SIZE];
+
+  write_loop_report(LOOP_REPORT_ID, report);
+  unsigned usPerTick = report[1];
+  unsigned frames = get_le(report + 2, 2);
+  printf("  passes            %9.1f     per frame, %u min, %u max over %u frames\n",
+         frames ? (double)get_le(report + 4, 4) / frames : 0.0,
+         (unsigned)get_le(report + 8, 2), (unsigned)get_le(report + 10, 2), frames);
+  printf("  longest pass      %9u us  in frame %u\n",
+         (unsigned)get_le(report + 12, 2) * usPerTick, report[14]);
+  printf("  longest irqs off  %9u us  in frame %u, %s\n",
+         (unsigned)get_le(report + 15, 2) * usPerTick, report[17],
+         report[18] < sizeof(sources) / sizeof(sources[0]) ? sources[report[18]] : "?");
+}
+
+// Prints the firmware's bounce statistics of every input that changed,
+// decoded from the feature reports.
+static void print_filter_reports(void)
+{
+  for (unsigned byte = 0; byte < NUM_CONTROLLER_STATE_BYTES; ++byte)
+  {
+    const uint8_t* report = filterReports[byte];
+    unsigned usPerTick = report[1];
+    unsigned usPerDebounceTick = get_le(report + 2, 2);
+    for (unsigned bit = 0; bit < 8; ++bit)
+    {
+      const uint8_t* input = report + 4 + bit * 8;
+      unsigned changes = get_le(input, 2);
+      if (!changes)
+        continue;
+      printf("  input %u.%u         %9u     changes, %u chatter, %u escapes\n",
+             byte, bit, changes, (unsigned)get_le(input + 2, 2), input[6]);
+      printf("    longest bounce  %9u us  window %u us\n",
+             (unsigned)get_le(input + 4, 2) * usPerTick, input[7] * usPerDebounceTick);
+    }
+  }
+}
+
+// Prints the outcome of the last tuning command sent with -w or -T, from
+// the firmware's settings report.
+static void print_tuning_report(void)
+{
+  static const char* const results[] = {"ok", "bad command", "bad argument"};
+  uint8_t report[TUNING_REPORT_SIZE];
+
+  write_tuning_report(TUNING_REPORT_ID, report);
+  printf("tuning              %9u us  window of input 0, %u Hz, command %u %s\n",
+         (unsigned)get_le(report + 11, 2), 1000 >> report[7], report[2],
+         report[3] < sizeof(results) / sizeof(results[0]) ? results[report[3]] : "?");
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "usage: sim [-v] [-c cycles] [-n edges] [-p phase] [-P profile] [-r script] [-R hz]\n"
+          "           [-b us] [-w us] [-T hz]\n"
+          "  -v          trace requests and edges\n"
+          "  -c cycles   cost of a register access (default %u)\n"
+          "  -n edges    button edges to measure (default %u)\n"
+          "  -p phase    host IN token, us after start-of-frame (default %u)\n"
+          "  -P profile  pc, ps3 or x360 (default pc)\n"
+          "  -r script   replay a script made by trace2replay\n"
+          "  -R hz       hold the button for a 1000, 500, 250 or 125 Hz polling rate\n"
+          "              at power-on\n"
+          "  -b us       bounce the button for this long after every edge\n"
+          "  -w us       set every debounce window over the tuning protocol after\n"
+          "              enumerating\n"
+          "  -T hz       set a 1000, 500, 250 or 125 Hz polling rate over the tuning\n"
+          "              protocol after enumerating\n",
+          DEFAULT_ACCESS_CYCLES, DEFAULT_EDGES, DEFAULT_POLL_PHASE_US);
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-v") == 0)
+      verbose = 1;
+    else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+      accessCycles = strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+      edgeCount = strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-p") == 0)
+      pollPhaseUs = strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-P") == 0)
+      profile = parse_profile(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+      load_replay(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-R") == 0)
+      bootRateHz = strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-b") == 0)
+      bounceUs = strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+      tunedWindowUs = strtol(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-T") == 0)
+      tunedRateHz = strtoul(argv[++i], NULL, 0);
+    else
+      usage();
+  }
+  if (edgeCount == 0 || pollPhaseUs >= 1000)
+    usage();
+  if (bootRateHz && bootRateHz != 1000 && bootRateHz != 500 && bootRateHz != 250
+      && bootRateHz != 125)
+    usage();
+  if (tunedRateHz && tunedRateHz != 1000 && tunedRateHz != 500 && tunedRateHz != 250
+      && tunedRateHz != 125)
+    usage();
+  if (tunedWindowUs >= 0 || tunedRateHz)
+  {
+    if (replaying || tunedWindowUs > 0xFFFF)
+      usage();
+    add_tuning_requests();
+  }
+
+  // Power-on state: EEPROM erased, inputs pulled up, device detached.
+  host_eeprom_erase();
+  host_reg8_storage[HOST_PINB] = 0xFF;
+  host_reg8_storage[HOST_PINC] = 0xFF;
+  host_reg8_storage[HOST_PIND] = 0xFF;
+  host_reg8_storage[HOST_PINF] = 0xFF;
+  host_reg8_storage[HOST_UDCON] = (1<<DETACH);
+  press_boot_button(1);
+  host_reg8_hook = sim_reg8;
+  host_reg16_hook = sim_reg16;
+
+  if (!setjmp(simExit))
+    firmware_main();
+
+  host_reg8_hook = 0;
+  host_reg16_hook = 0;
+
+  printf("enumeration         %9.1f us  %u requests, %u stalled, %u frames\n",
+         to_us(enumerationTime), numRequests, stalls,
+         (unsigned)(enumerationTime / US(1000)));
+  printf("  slowest request   %9.1f us  %s\n", to_us(slowestRequest), slowestRequestName);
+  printf("first report        %9.1f us  after SET_CONFIGURATION, %.1f us after power-on\n",
+         to_us(firstReportAt - configuredAt), to_us(firstReportAt));
+  printf("edge to report      %9.1f us  avg, %.1f min, %.1f max over %u edges\n",
+         to_us(latencyTotal) / edgesSeen, to_us(latencyMin), to_us(latencyMax), edgesSeen);
+  printf("  frames            %9u     min, %u max\n", framesMin, framesMax);
+  printf("interrupts off      %9.1f us  worst, in %s\n", to_us(worstDisabled),
+         worstDisabledIn ? worstDisabledIn : "-");
+  printf("reports             %9u     at %u frame interval\n", reports, pollInterval);
+  printf("device latency\n");
+  print_latency_reports();
+  printf("device main loop\n");
+  print_loop_report();
+  printf("device bounce\n");
+  print_filter_reports();
+  if (tunedWindowUs >= 0 || tunedRateHz)
+    print_tuning_report();
+  if (replaying)
+  {
+    printf("replay              %9.1f us  in requests, %u over budget, %u with the wrong length\n",
+           to_us(replayRequestTime), overBudget, wrongLength);
+    if (overBudget || wrongLength)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,366 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// Turns a Wireshark text export of a usbmon capture ("File > Export
+// Packet Dissections > As Plain Text", packet details expanded) into a
+// replay script for "sim -r".  Only the decoded setup fields, URB
+// lengths and timestamps are used, so captures with truncated payloads
+// work.
+//
+// The device followed is the one given the address of the first
+// SET_ADDRESS in the capture, or the address given on the command line.
+// The script starts at the hub port reset that followed its connection
+// and lists, in order, every port reset and every control request sent to
+// the device, at address 0 up to SET_ADDRESS and at its own address
+// after.  Each line is one of
+//
+//   reset   <gap>
+//   control <gap> <budget> <length> <bmRequestType> <bRequest> <wValue> <wIndex> <wLength> <name>
+//
+// where <gap> is how long the host waited after the previous step ended
+// before starting this one, <budget> is how long the captured device took
+// to complete the request, both in microseconds, and <length> is how many
+// bytes it returned (0 for a stall).  Lines starting with '#' are
+// comments.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_SIZE 512
+
+// Hub class requests that reset a port, and the change bit that reports
+// a new connection.
+#define HUB_PORT_REQUEST 0x23
+#define HUB_SET_FEATURE 3
+#define HUB_CLEAR_FEATURE 1
+#define PORT_RESET 4
+#define C_PORT_CONNECTION 16
+
+struct Urb
+{
+  unsigned frame;
+  double time;
+  int submit;
+  int control;
+  int device;
+  int endpoint;
+  int hasSetup;
+  uint8_t bmRequestType;
+  uint8_t bRequest;
+  uint16_t wValue;
+  uint16_t wIndex;
+  uint16_t wLength;
+  int length;
+  int stalled;
+  unsigned response;
+  double responseTime;
+  int responseLength;
+  int responseStalled;
+};
+
+static struct Urb* urbs;
+static unsigned urbCount;
+
+// Value in the last parentheses on the line, or after the last ": ".
+static unsigned long field_value(const char* line)
+{
+  const char* open = strrchr(line, '(');
+  const char* colon = strrchr(line, ':');
+
+  if (open && strchr(open, ')'))
+    return strtoul(open + 1, NULL, 0);
+  return colon ? strtoul(colon + 1, NULL, 0) : 0;
+}
+
+static int starts_with(const char* line, const char* prefix)
+{
+  return strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+static void parse_line(struct Urb* urb, int* inSetup, const char* line)
+{
+  const char* text = line + strspn(line, " ");
+  unsigned indent = text - line;
+
+  if (starts_with(text, "[Time since reference or first frame:"))
+    urb->time = strtod(strchr(text, ':') + 1, NULL);
+  else if (starts_with(text, "URB type:"))
+    urb->submit = strstr(text, "URB_SUBMIT") != NULL;
+  else if (starts_with(text, "URB transfer type:"))
+    urb->control = strstr(text, "URB_CONTROL") != NULL;
+  else if (starts_with(text, "Endpoint:") && indent == 4)
+    urb->endpoint = strtoul(text + 9, NULL, 0) & 0x7F;
+  else if (starts_with(text, "URB status:"))
+    urb->stalled = strstr(text, "EPIPE") != NULL || strstr(text, "(-32)") != NULL;
+  else if (starts_with(text, "URB length [bytes]:"))
+    urb->length = field_value(text);
+  else if (starts_with(text, "[Response in:"))
+    urb->response = field_value(text);
+  else if (starts_with(text, "URB setup"))
+    *inSetup = urb->hasSetup = 1;
+  else if (starts_with(text, "Device:") && !*inSetup)
+    urb->device = field_value(text);
+  else if (!*inSetup || indent > 8)
+    return;
+  // Setup fields.  Wireshark decodes some of them, so wValue and wIndex
+  // can appear under several names.
+  else if (starts_with(text, "bmRequestType:"))
+    urb->bmRequestType = field_value(text);
+  else if (starts_with(text, "bRequest:"))
+    urb->bRequest = field_value(text);
+  else if (starts_with(text, "wValue:"))
+    urb->wValue = field_value(text);
+  else if (starts_with(text, "Descriptor Index:"))
+    urb->wValue = (urb->wValue & 0xFF00) | field_value(text);
+  else if (starts_with(text, "bDescriptorType:"))
+    urb->wValue = (urb->wValue & 0x00FF) | (field_value(text) << 8);
+  else if (starts_with(text, "Device:") || starts_with(text, "bConfigurationValue:"))
+    urb->wValue = field_value(text);
+  else if (starts_with(text, "wIndex:") || starts_with(text, "Language Id:"))
+    urb->wIndex = field_value(text);
+  else if (starts_with(text, "wLength:"))
+    urb->wLength = field_value(text);
+}
+
+static void read_capture(FILE* file)
+{
+  char line[LINE_SIZE];
+  struct Urb* urb = NULL;
+  int inSetup = 0;
+
+  while (fgets(line, sizeof(line), file))
+  {
+    line[strcspn(line, "\r\n")] = 0;
+    if (starts_with(line, "Frame ") && strchr(line, ':'))
+    {
+      urbs = realloc(urbs, (urbCount + 1) * sizeof(*urbs));
+      if (!urbs)
+      {
+        perror("trace2replay");
+        exit(1);
+      }
+      urb = &urbs[urbCount++];
+      memset(urb, 0, sizeof(*urb));
+      urb->frame = strtoul(line + 6, NULL, 10);
+      urb->device = -1;
+      inSetup = 0;
+    }
+    else if (urb)
+    {
+      parse_line(urb, &inSetup, line);
+    }
+  }
+}
+
+static struct Urb* find_frame(unsigned frame)
+{
+  for (unsigned i = 0; i < urbCount; ++i)
+  {
+    if (urbs[i].frame == frame)
+      return &urbs[i];
+  }
+  return NULL;
+}
+
+static void match_responses(void)
+{
+  for (unsigned i = 0; i < urbCount; ++i)
+  {
+    struct Urb* response = urbs[i].response ? find_frame(urbs[i].response) : NULL;
+
+    if (response)
+    {
+      urbs[i].responseTime = response->time;
+      urbs[i].responseLength = response->stalled ? 0 : response->length;
+      urbs[i].responseStalled = response->stalled;
+    }
+    else
+    {
+      urbs[i].responseTime = urbs[i].time;
+      urbs[i].responseLength = -1;
+    }
+  }
+}
+
+static int is_request(const struct Urb* urb)
+{
+  return urb->submit && urb->control && urb->hasSetup && urb->endpoint == 0;
+}
+
+static int is_port_request(const struct Urb* urb, uint8_t request, uint16_t feature)
+{
+  return is_request(urb) && urb->bmRequestType == HUB_PORT_REQUEST
+    && urb->bRequest == request && urb->wValue == feature;
+}
+
+static int is_set_address(const struct Urb* urb)
+{
+  return is_request(urb) && urb->device == 0 && urb->bmRequestType == 0x00
+    && urb->bRequest == 5;
+}
+
+static void request_name(const struct Urb* urb, char* name, size_t size)
+{
+  static const char* descriptors[] =
+  {
+    "?", "device", "config", "string", "interface", "endpoint", "qualifier"
+  };
+  uint8_t type = urb->wValue >> 8;
+
+  if (urb->bRequest == 6 && !(urb->bmRequestType & 0x60))
+  {
+    if (type == 3)
+      snprintf(name, size, "GET_DESCRIPTOR string %u", urb->wValue & 0xFF);
+    else if (type < sizeof(descriptors) / sizeof(descriptors[0]))
+      snprintf(name, size, "GET_DESCRIPTOR %s", descriptors[type]);
+    else if (type == 0x21)
+      snprintf(name, size, "GET_DESCRIPTOR HID");
+    else if (type == 0x22)
+      snprintf(name, size, "GET_DESCRIPTOR report");
+    else
+      snprintf(name, size, "GET_DESCRIPTOR 0x%04X", urb->wValue);
+  }
+  else if (urb->bmRequestType == 0x00 && urb->bRequest == 5)
+    snprintf(name, size, "SET_ADDRESS");
+  else if (urb->bmRequestType == 0x00 && urb->bRequest == 9)
+    snprintf(name, size, "SET_CONFIGURATION");
+  else if (urb->bmRequestType == 0x21 && urb->bRequest == 10)
+    snprintf(name, size, "SET_IDLE");
+  else if (urb->bmRequestType == 0xA1 && urb->bRequest == 1)
+    snprintf(name, size, "GET_REPORT 0x%04X", urb->wValue);
+  else if (urb->bmRequestType == 0x21 && urb->bRequest == 9)
+    snprintf(name, size, "SET_REPORT 0x%04X", urb->wValue);
+  else
+    snprintf(name, size, "request 0x%02X/0x%02X", urb->bmRequestType, urb->bRequest);
+}
+
+static unsigned to_us(double seconds)
+{
+  return seconds > 0 ? (unsigned)(seconds * 1e6 + 0.5) : 0;
+}
+
+int main(int argc, char** argv)
+{
+  FILE* file;
+  int address = -1;
+  unsigned setAddress = 0;
+  unsigned start = 0;
+  int hub = -1;
+  uint16_t port = 0;
+  double lastEnd = 0;
+  unsigned steps = 0;
+  char name[64];
+
+  if (argc < 2 || argc > 3)
+  {
+    fprintf(stderr, "usage: trace2replay capture.txt [address]\n");
+    return 1;
+  }
+  file = fopen(argv[1], "r");
+  if (!file)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  if (argc == 3)
+    address = strtoul(argv[2], NULL, 0);
+  read_capture(file);
+  fclose(file);
+  match_responses();
+
+  // Find the SET_ADDRESS that gave the device its address.
+  for (setAddress = 0; setAddress < urbCount; ++setAddress)
+  {
+    if (is_set_address(&urbs[setAddress])
+        && (address < 0 || urbs[setAddress].wValue == address))
+      break;
+  }
+  if (setAddress == urbCount)
+  {
+    fprintf(stderr, "trace2replay: no SET_ADDRESS found in %s\n", argv[1]);
+    return 1;
+  }
+  address = urbs[setAddress].wValue;
+
+  // The hub port it is on is the one last reset before that, and the
+  // script starts at the first reset after the port saw it connect.
+  for (unsigned i = setAddress; i-- > 0; )
+  {
+    if (hub < 0 && is_port_request(&urbs[i], HUB_SET_FEATURE, PORT_RESET))
+    {
+      hub = urbs[i].device;
+      port = urbs[i].wIndex;
+    }
+    if (hub >= 0 && urbs[i].device == hub && urbs[i].wIndex == port)
+    {
+      if (is_port_request(&urbs[i], HUB_CLEAR_FEATURE, C_PORT_CONNECTION))
+        break;
+      if (is_port_request(&urbs[i], HUB_SET_FEATURE, PORT_RESET))
+        start = i;
+    }
+  }
+  if (hub < 0)
+    start = setAddress;
+
+  printf("# Replay script for sim -r, made by trace2replay from %s.\n", argv[1]);
+  printf("# Device at address %d", address);
+  if (hub >= 0)
+    printf(", on port %u of the hub at address %d", port, hub);
+  printf(".\n#\n");
+  printf("# %-7s %7s %7s %6s %4s %4s %6s %6s %5s %s\n", "step", "gap", "budget",
+         "length", "type", "req", "value", "index", "wLen", "name");
+
+  lastEnd = urbs[start].time;
+  for (unsigned i = start; i < urbCount; ++i)
+  {
+    const struct Urb* urb = &urbs[i];
+
+    if (hub >= 0 && urb->device == hub && urb->wIndex == port
+        && is_port_request(urb, HUB_SET_FEATURE, PORT_RESET))
+    {
+      printf("reset   %9u\n", to_us(urb->time - lastEnd));
+      lastEnd = urb->time;
+      ++steps;
+      continue;
+    }
+    if (!is_request(urb) || urb->responseLength < 0)
+      continue;
+    if (urb->device != address && !(urb->device == 0 && i <= setAddress))
+      continue;
+    request_name(urb, name, sizeof(name));
+    printf("control %9u %7u %6d 0x%02X 0x%02X 0x%04X 0x%04X %5u %s\n",
+           to_us(urb->time - lastEnd), to_us(urb->responseTime - urb->time),
+           urb->responseLength, urb->bmRequestType, urb->bRequest, urb->wValue,
+           urb->wIndex, urb->wLength, name);
+    lastEnd = urb->responseTime;
+    ++steps;
+  }
+  fprintf(stderr, "trace2replay: %u steps for the device at address %d\n", steps, address);
+  return 0;
+}
@@ -26,58 +26,436 @@
 
 #include "input_filter.h"
 #include "macros.h"
+#include "timer.h"
+#include "config_store.h"
 #include <stdint.h>
 
-static const uint8_t STABILITY_COUNT_THRESHOLD = 20;
+// Largest value a vertical counter can hold.
+#define STABILITY_COUNTER_MAX ((1 << STABILITY_COUNTER_BITS) - 1)
 
-void init_input_filter(struct InputFilter* inputFilter)
+// How far back in time a sample passed to filter_input_at() may be.
+#define STALE_SAMPLE_TICKS TIMER_US_TO_TICKS(16000)
+
+// Converts a window in microseconds to debounce ticks.  A bit starts
+// counting on the first tick boundary after its change is seen, so one
+// extra tick keeps the window from ending early.
+#define WINDOW_US_TO_TICKS(us) ((us) / DEBOUNCE_TICK_US + 1)
+
+// The filter whose statistics write_input_filter_report() reads.
+static struct InputFilter* reportedFilter;
+
+static void set_threshold_ticks(struct InputFilter* inputFilter, uint8_t stateByte, uint8_t mask, uint8_t ticks)
 {
-  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  uint8_t* threshold = inputFilter->inputBitStabilityThreshold[stateByte];
+  for (uint8_t p = 0; p < STABILITY_COUNTER_BITS; ++p)
   {
-    for (uint8_t j = 0; j < BITS_PER_BYTE; ++j)
+    if (ticks & (1<<p))
     {
-      inputFilter->inputBitStabilityCounter[i][j] = 0;
+      threshold[p] |= mask;
+    }
+    else
+    {
+      threshold[p] &= ~mask;
     }
   }
 }
 
-void filter_input(struct InputFilter* inputFilter, uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES])
+// Moves the window of one input to its bounce estimate plus the margin,
+// within its bounds, or to its upper bound when adaptation is off.
+static void adapt_window(struct InputFilter* inputFilter, uint8_t stateByte, uint8_t bit, struct InputChatter* chatter)
 {
-  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  uint8_t window = chatter->maxWindow;
+  if (inputFilter->adaptive)
+  {
+    uint8_t ticks = chatter->estimate + WINDOW_US_TO_TICKS(ADAPTIVE_DEBOUNCE_MARGIN_US);
+    if (ticks < WINDOW_US_TO_TICKS(ADAPTIVE_DEBOUNCE_MIN_US))
+    {
+      ticks = WINDOW_US_TO_TICKS(ADAPTIVE_DEBOUNCE_MIN_US);
+    }
+    if (ticks < window)
+    {
+      window = ticks;
+    }
+  }
+
+  if (window != chatter->stats.window)
+  {
+    chatter->stats.window = window;
+    set_threshold_ticks(inputFilter, stateByte, 1 << bit, window);
+    inputFilter->unpublishedStats |= 1 << stateByte;
+  }
+}
+
+// Ends the bounce episodes of one state byte that have been quiet for
+// longer than their upper bound, and the settling time after the commits
+// that are that old.  Runs once per debounce tick while an input of the
+// byte is bouncing or settling, so the 16-bit times never wrap.
+static void age_bounce(struct InputFilter* inputFilter, uint8_t stateByte, uint16_t timestamp)
+{
+  const struct InputChatter* chatter = inputFilter->chatter + stateByte * BITS_PER_BYTE;
+  uint8_t quietBits = 0;
+  uint8_t settledBits = 0;
+  for (uint8_t bit = 0; bit < BITS_PER_BYTE; ++bit, ++chatter)
+  {
+    uint16_t maxWindowTicks = (uint16_t)chatter->maxWindow << DEBOUNCE_TICK_SHIFT;
+    if ((uint16_t)(timestamp - chatter->bounceTime) > maxWindowTicks)
+    {
+      quietBits |= 1 << bit;
+    }
+    if ((uint16_t)(timestamp - chatter->changeTime) > maxWindowTicks)
+    {
+      settledBits |= 1 << bit;
+    }
+  }
+  inputFilter->bouncingInputBits[stateByte] &= ~quietBits;
+  inputFilter->settlingInputBits[stateByte] &= ~settledBits;
+}
+
+// Copies the statistics of one state byte to the slot the report does not
+// read, then makes it the one it does.
+static void publish_stats(struct InputFilter* inputFilter, uint8_t stateByte)
+{
+  struct InputBounceStats* stats = seq_buffer_next(&inputFilter->statsBuffer[stateByte]);
+  const struct InputChatter* chatter = inputFilter->chatter + stateByte * BITS_PER_BYTE;
+  for (uint8_t bit = 0; bit < BITS_PER_BYTE; ++bit)
+  {
+    stats[bit] = chatter[bit].stats;
+  }
+  seq_buffer_publish(&inputFilter->statsBuffer[stateByte]);
+  inputFilter->unpublishedStats &= ~(1 << stateByte);
+}
+
+// Updates the bounce statistics of the debounced inputs of one state byte
+// that started or continued bouncing, flipped back to their trusted state,
+// or were committed on this pass.  Only runs when one of them did, so a
+// steady pass costs a few mask operations.  The statistics are only read
+// through the published copy, so nothing here runs with interrupts
+// disabled.
+static void record_bounce(struct InputFilter* inputFilter, uint8_t stateByte, uint8_t startedBits, uint8_t chatterBits, uint8_t committedBits, uint16_t timestamp)
+{
+  struct InputChatter* chatter = inputFilter->chatter + stateByte * BITS_PER_BYTE;
+  uint8_t* bouncingBits = &inputFilter->bouncingInputBits[stateByte];
+  uint8_t* settlingBits = &inputFilter->settlingInputBits[stateByte];
+
+  inputFilter->unpublishedStats |= 1 << stateByte;
+  for (uint8_t bit = 0; bit < BITS_PER_BYTE; ++bit, ++chatter)
   {
-    uint8_t changedBits = inputFilter->lastInputBits[i] ^ inputBits[i];
-    for (uint8_t j = 0; j < BITS_PER_BYTE; ++j)
+    uint8_t mask = 1 << bit;
+
+    if (chatterBits & mask)
     {
-      if (changedBits & (1<<j))
+      chatter->bounceTime = timestamp;
+      if (chatter->stats.chatter != UINT16_MAX)
       {
-        inputFilter->inputBitStabilityCounter[i][j] = 0;
+        ++chatter->stats.chatter;
       }
-      else
+    }
+
+    if (startedBits & mask)
+    {
+      // A change while the last commit is still settling means the
+      // bounce outlasted the window: put the window back to its bound.
+      if (*settlingBits & mask)
       {
-        if (inputFilter->inputBitStabilityCounter[i][j] == 0xFF)
+        if (chatter->stats.escapes != UINT8_MAX)
         {
-          // Input is correct and stable, do nothing
+          ++chatter->stats.escapes;
         }
-        else if (inputFilter->inputBitStabilityCounter[i][j] > STABILITY_COUNT_THRESHOLD)
+        chatter->estimate = chatter->maxWindow;
+        chatter->quietChanges = 0;
+        chatter->recentBounce = 0;
+        adapt_window(inputFilter, stateByte, bit, chatter);
+        *settlingBits &= ~mask;
+      }
+      if (!(*bouncingBits & mask))
+      {
+        *bouncingBits |= mask;
+        chatter->changeTime = timestamp;
+      }
+      chatter->bounceTime = timestamp;
+    }
+
+    if (committedBits & mask)
+    {
+      // The bounce lasted from the first change of the episode to the
+      // flip that held.
+      uint16_t bounce = chatter->bounceTime - chatter->changeTime;
+      if (bounce > chatter->stats.maxBounce)
+      {
+        chatter->stats.maxBounce = bounce;
+      }
+      if (chatter->stats.changes != UINT16_MAX)
+      {
+        ++chatter->stats.changes;
+      }
+
+      // The first measurement replaces the guess, and a longer bounce
+      // raises the estimate at once.  Shorter ones lower it by half the
+      // gap every ADAPTIVE_DECAY_CHANGES changes, so a clean switch
+      // reaches its minimum window within a few dozen presses.
+      uint16_t bounceTicks = (bounce + (1 << DEBOUNCE_TICK_SHIFT) - 1) >> DEBOUNCE_TICK_SHIFT;
+      if (bounceTicks > chatter->maxWindow)
+      {
+        bounceTicks = chatter->maxWindow;
+      }
+      if (!chatter->measured || bounceTicks >= chatter->estimate)
+      {
+        chatter->estimate = bounceTicks;
+        chatter->quietChanges = 0;
+        chatter->recentBounce = 0;
+        chatter->measured = 1;
+      }
+      else
+      {
+        if (bounceTicks > chatter->recentBounce)
         {
-          inputFilter->inputBitStabilityCounter[i][j] = 0xFF;
-
-          if (inputBits[i] & (1<<j))
-          {
-            inputFilter->lastTrustedInputBits[i] |= (1<<j);
-          }
-          else
-          {
-            inputFilter->lastTrustedInputBits[i] &= ~(1<<j);
-          }
+          chatter->recentBounce = bounceTicks;
         }
-        else
+        if (++chatter->quietChanges >= ADAPTIVE_DECAY_CHANGES)
         {
-          inputFilter->inputBitStabilityCounter[i][j] += 1;
+          chatter->estimate -= (chatter->estimate - chatter->recentBounce + 1) / 2;
+          chatter->quietChanges = 0;
+          chatter->recentBounce = 0;
         }
       }
+      adapt_window(inputFilter, stateByte, bit, chatter);
+
+      *bouncingBits &= ~mask;
+      *settlingBits |= mask;
+      chatter->changeTime = timestamp;
+      chatter->bounceTime = timestamp;
+    }
+  }
+}
+
+void init_input_filter(struct InputFilter* inputFilter)
+{
+  const struct Config* config = get_config();
+
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    inputFilter->lastTrustedInputBits[i] = 0;
+    inputFilter->pendingInputBits[i] = 0;
+    inputFilter->lockedInputBits[i] = 0;
+    inputFilter->debouncingInputBits[i] = 0;
+    inputFilter->bouncingInputBits[i] = 0;
+    inputFilter->settlingInputBits[i] = 0;
+    for (uint8_t p = 0; p < STABILITY_COUNTER_BITS; ++p)
+    {
+      inputFilter->inputBitStabilityCounter[i][p] = 0;
+    }
+
+    for (uint8_t bit = 0; bit < BITS_PER_BYTE; ++bit)
+    {
+      set_input_filter_window(inputFilter, i, 1 << bit, config->debounceUs[i * BITS_PER_BYTE + bit]);
     }
-    inputFilter->lastInputBits[i] = inputBits[i];
+  }
+
+  set_input_filter_mode(inputFilter, config->pressMode, config->releaseMode);
+  set_input_filter_adaptive(inputFilter, config->adaptiveDebounce);
+  inputFilter->tickStartTime = timer_now();
+
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES * BITS_PER_BYTE; ++i)
+  {
+    struct InputChatter* chatter = &inputFilter->chatter[i];
+    chatter->changeTime = inputFilter->tickStartTime;
+    chatter->bounceTime = inputFilter->tickStartTime;
+    chatter->stats.changes = 0;
+    chatter->stats.chatter = 0;
+    chatter->stats.maxBounce = 0;
+    chatter->stats.escapes = 0;
+  }
+
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    struct SeqBuffer* buffer = &inputFilter->statsBuffer[i];
+    buffer->sequence = 0;
+    buffer->size = sizeof(inputFilter->publishedStats[i][0]);
+    buffer->slots = (uint8_t*)inputFilter->publishedStats[i];
+    publish_stats(inputFilter, i);
+  }
+
+  reportedFilter = inputFilter;
+}
+
+void set_input_filter_adaptive(struct InputFilter* inputFilter, uint8_t adaptive)
+{
+  inputFilter->adaptive = adaptive;
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES * BITS_PER_BYTE; ++i)
+  {
+    struct InputChatter* chatter = &inputFilter->chatter[i];
+    chatter->estimate = chatter->maxWindow;
+    chatter->quietChanges = 0;
+    chatter->recentBounce = 0;
+    chatter->measured = 0;
+    adapt_window(inputFilter, i / BITS_PER_BYTE, i % BITS_PER_BYTE, chatter);
+  }
+}
+
+void set_input_filter_mode(struct InputFilter* inputFilter, enum InputFilterMode pressMode, enum InputFilterMode releaseMode)
+{
+  inputFilter->eagerPressMask = (pressMode == FILTER_EAGER) ? 0xFF : 0x00;
+  inputFilter->eagerReleaseMask = (releaseMode == FILTER_EAGER) ? 0xFF : 0x00;
+}
+
+void set_input_filter_window(struct InputFilter* inputFilter, uint8_t stateByte, uint8_t mask, uint16_t windowUs)
+{
+  uint16_t ticks = WINDOW_US_TO_TICKS(windowUs);
+  if (ticks > STABILITY_COUNTER_MAX)
+  {
+    ticks = STABILITY_COUNTER_MAX;
+  }
+  set_threshold_ticks(inputFilter, stateByte, mask, ticks);
+
+  // The window set here is the upper bound for adaptation, and the
+  // estimate starts over from it.
+  struct InputChatter* chatter = inputFilter->chatter + stateByte * BITS_PER_BYTE;
+  for (uint8_t bit = 0; bit < BITS_PER_BYTE; ++bit, ++chatter)
+  {
+    if (mask & (1 << bit))
+    {
+      chatter->maxWindow = ticks;
+      chatter->estimate = ticks;
+      chatter->stats.window = ticks;
+      chatter->quietChanges = 0;
+      chatter->recentBounce = 0;
+      chatter->measured = 0;
+    }
+  }
+  inputFilter->unpublishedStats |= 1 << stateByte;
+}
+
+void filter_input(struct InputFilter* inputFilter, uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES])
+{
+  filter_input_at(inputFilter, inputBits, timer_now());
+}
+
+void filter_input_at(struct InputFilter* inputFilter, uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES], uint16_t timestamp)
+{
+  // Work out how many whole debounce ticks have passed since the last pass.
+  // A captured edge can be slightly older than the start of the current
+  // tick; it gets no credit rather than a wrapped-around elapsed time.
+  uint16_t elapsed = timestamp - inputFilter->tickStartTime;
+  if (elapsed > (uint16_t)-STALE_SAMPLE_TICKS)
+  {
+    elapsed = 0;
+  }
+  uint16_t ticks = elapsed >> DEBOUNCE_TICK_SHIFT;
+  if (ticks > STABILITY_COUNTER_MAX)
+  {
+    ticks = STABILITY_COUNTER_MAX;
+  }
+  inputFilter->tickStartTime += elapsed & ~((1 << DEBOUNCE_TICK_SHIFT) - 1);
+
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    uint8_t* counter = inputFilter->inputBitStabilityCounter[i];
+    const uint8_t* threshold = inputFilter->inputBitStabilityThreshold[i];
+
+    // Report eager edges right away and lock those inputs out for their
+    // window.  Changes on a locked input are ignored until the lockout ends.
+    uint8_t changedBits = inputBits[i] ^ inputFilter->lastTrustedInputBits[i];
+    uint8_t eagerBits = (inputBits[i] & inputFilter->eagerPressMask) |
+                        (~inputBits[i] & inputFilter->eagerReleaseMask);
+    uint8_t firedBits = changedBits & eagerBits & ~inputFilter->lockedInputBits[i];
+    uint8_t lockedBits = inputFilter->lockedInputBits[i] | firedBits;
+    inputFilter->lastTrustedInputBits[i] ^= firedBits;
+
+    // Locked bits count towards the end of their lockout.  Debounced bits
+    // that disagree with the trusted state keep counting, all other
+    // counters are reset to zero.  A bit that only just started counting
+    // starts from zero and is credited from the next pass on.
+    uint8_t activeBits = lockedBits | (changedBits & ~eagerBits);
+    uint8_t countingBits = activeBits & ~firedBits & inputFilter->pendingInputBits[i];
+
+    // Add the elapsed ticks to the counting bits with a ripple-carry adder
+    // across the planes.  The loop only branches on the tick count, never on
+    // the input bits.
+    uint8_t carry = 0;
+    for (uint8_t p = 0; p < STABILITY_COUNTER_BITS; ++p)
+    {
+      uint8_t plane = counter[p] & countingBits;
+      uint8_t addend = (ticks & (1<<p)) ? countingBits : 0;
+      counter[p] = plane ^ addend ^ carry;
+      carry = (plane & addend) | (carry & (plane ^ addend));
+    }
+
+    // Saturate instead of wrapping around.
+    for (uint8_t p = 0; p < STABILITY_COUNTER_BITS; ++p)
+    {
+      counter[p] |= carry;
+    }
+
+    // Compare counters against thresholds from the top plane down.
+    uint8_t greater = 0;
+    uint8_t equal = 0xFF;
+    for (uint8_t p = STABILITY_COUNTER_BITS; p-- > 0;)
+    {
+      greater |= equal & counter[p] & ~threshold[p];
+      equal &= ~(counter[p] ^ threshold[p]);
+    }
+    uint8_t expiredBits = activeBits & (greater | equal);
+
+    // Release the inputs whose lockout has ended, and accept the debounced
+    // inputs that have been stable long enough.  Either way their counters
+    // start over.
+    inputFilter->lockedInputBits[i] = lockedBits & ~expiredBits;
+    inputFilter->pendingInputBits[i] = activeBits & ~expiredBits;
+    inputFilter->lastTrustedInputBits[i] ^= expiredBits & ~lockedBits;
     inputBits[i] = inputFilter->lastTrustedInputBits[i];
+
+    // Follow the debounced bits through their bounce episodes.  A bit that
+    // was counting and no longer disagrees with the trusted state without
+    // having been accepted flipped back: that is chatter.
+    uint8_t debouncingBits = changedBits & ~eagerBits & ~lockedBits & ~expiredBits;
+    uint8_t startedBits = debouncingBits & ~inputFilter->debouncingInputBits[i];
+    uint8_t committedBits = expiredBits & ~lockedBits;
+    uint8_t chatterBits = inputFilter->debouncingInputBits[i] & ~debouncingBits & ~committedBits;
+    inputFilter->debouncingInputBits[i] = debouncingBits;
+    if (startedBits | chatterBits | committedBits)
+    {
+      record_bounce(inputFilter, i, startedBits, chatterBits, committedBits, timestamp);
+    }
+    else if (ticks && (inputFilter->bouncingInputBits[i] | inputFilter->settlingInputBits[i]))
+    {
+      age_bounce(inputFilter, i, timestamp);
+    }
+
+    // Publish changed statistics on tick boundaries only, so a bouncing
+    // switch does not cost a copy on every pass.
+    if (ticks && (inputFilter->unpublishedStats & (1 << i)))
+    {
+      publish_stats(inputFilter, i);
+    }
+  }
+}
+
+uint8_t write_input_filter_report(uint8_t stateByte, uint8_t reportId, uint8_t report[INPUT_FILTER_REPORT_SIZE])
+{
+  if (!reportedFilter || stateByte >= NUM_CONTROLLER_STATE_BYTES)
+  {
+    return 0;
   }
-}
\ No newline at end of file
+
+  report[0] = reportId;
+  report[1] = TIMER_US_PER_TICK;
+  report[2] = DEBOUNCE_TICK_US & 0xFF;
+  report[3] = DEBOUNCE_TICK_US >> 8;
+
+  // Interrupt handlers are not interrupted by the main loop, so the
+  // current copy can be read in place.
+  uint8_t* field = report + 4;
+  const struct InputBounceStats* stats = seq_buffer_current(&reportedFilter->statsBuffer[stateByte]);
+  for (uint8_t bit = 0; bit < BITS_PER_BYTE; ++bit, ++stats)
+  {
+    *field++ = stats->changes & 0xFF;
+    *field++ = stats->changes >> 8;
+    *field++ = stats->chatter & 0xFF;
+    *field++ = stats->chatter >> 8;
+    *field++ = stats->maxBounce & 0xFF;
+    *field++ = stats->maxBounce >> 8;
+    *field++ = stats->escapes;
+    *field++ = stats->window;
+  }
+  return INPUT_FILTER_REPORT_SIZE;
+}
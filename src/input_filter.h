@@ -29,30 +29,204 @@
 
 #include "pins.h"
 #include "macros.h"
+#include "timer.h"
+#include "seq_buffer.h"
 #include <stdint.h>
 
 // Filters raw input from external mechanical devices.  Currently the code
 // only filters out jitter in the input data due to bouncing (switches).
+//
+// A changed input is trusted once it has held its new value for a debounce
+// window measured against the free-running timer (see timer.h), so the
+// window does not depend on how fast the main loop runs.  Time is counted
+// in debounce ticks of DEBOUNCE_TICK_US.
+//
+// Each input bit owns a counter of debounce ticks spent disagreeing with
+// its trusted state.  The counters are stored bit-sliced ("vertical"
+// counters): plane p of state byte i holds bit p of the eight counters for
+// that byte, so all eight inputs of a byte are counted and compared with a
+// handful of bitwise operations and no per-bit branches.  Thresholds are
+// stored the same way, which gives every input its own window.
+//
+// Presses and releases can each be filtered in one of two modes.  In
+// FILTER_DEBOUNCED mode a change is reported once it has held for the
+// input's window.  In FILTER_EAGER mode the first edge is reported right
+// away and the input is then locked out for its window, so any bounce
+// after the edge is ignored.  A set bit in the state bytes is a pressed
+// input.
+//
+// The filter also watches how each input bounces.  For debounced changes
+// it counts chatter (the raw input flipping back to the trusted state
+// inside the window) and measures how long the bouncing lasted.  With
+// adaptive windows enabled, each input's window follows its own bounce
+// plus a margin, between ADAPTIVE_DEBOUNCE_MIN_US and the window set for
+// it, which is the upper bound.  A window starts at that bound until the
+// first change has been measured, and then follows the longest bounce:
+// it grows at once to cover a longer one, and every
+// ADAPTIVE_DECAY_CHANGES changes it closes half the gap to the longest
+// bounce among them.  A change that starts within the upper bound of the
+// previous commit is counted as an escape: bouncing outlasted the window,
+// so the window goes back to its bound and shrinks again from there.
+
+enum InputFilterMode
+{
+  FILTER_DEBOUNCED,
+  FILTER_EAGER
+};
+
+// Default filter modes for presses and releases.
+#define PRESS_FILTER_MODE FILTER_DEBOUNCED
+#define RELEASE_FILTER_MODE FILTER_DEBOUNCED
+
+// Default debounce (or lockout) windows for the joystick directions and
+// for the buttons.
+#define STICK_DEBOUNCE_US 8000
+#define BUTTON_DEBOUNCE_US 5000
+
+// Resolution of the debounce windows.  A window is rounded up to whole
+// ticks and may run up to one tick longer than requested.
+#define DEBOUNCE_TICK_SHIFT 7
+#define DEBOUNCE_TICK_US (TIMER_US_PER_TICK << DEBOUNCE_TICK_SHIFT)
+
+// Adaptive windows on by default, their lower bound and tuning.
+#define ADAPTIVE_DEBOUNCE 1
+#define ADAPTIVE_DEBOUNCE_MIN_US 1000
+#define ADAPTIVE_DEBOUNCE_MARGIN_US 1000
+#define ADAPTIVE_DECAY_CHANGES 8
+
+// Number of bit planes in each vertical counter.  The longest window is
+// ((1 << STABILITY_COUNTER_BITS) - 1) debounce ticks.
+#define STABILITY_COUNTER_BITS 5
+
+// Longest window set_input_filter_window() takes without shortening it.
+#define MAX_DEBOUNCE_US (((1 << STABILITY_COUNTER_BITS) - 2) * DEBOUNCE_TICK_US)
+
+// Bounce statistics of one input, as read back in the report.
+struct InputBounceStats
+{
+  // Debounced changes committed, chatter flips seen, and the longest
+  // bounce in timer ticks.  The counts stop at their maximum.
+  uint16_t changes;
+  uint16_t chatter;
+  uint16_t maxBounce;
+
+  // Changes that started too soon after the previous commit.
+  uint8_t escapes;
+
+  // Current window in debounce ticks.
+  uint8_t window;
+};
+
+// Bounce statistics and adaptive window state of one input.
+struct InputChatter
+{
+  // Start of the current bounce episode, or time of the last commit.
+  uint16_t changeTime;
+
+  // Last time the raw input flipped back during the current episode.
+  uint16_t bounceTime;
+
+  struct InputBounceStats stats;
+
+  // Bounce estimate and the upper bound of the window, in debounce ticks,
+  // changes since the estimate last moved and the longest bounce among
+  // them.  The estimate is only a guess until 'measured' is set.
+  uint8_t estimate;
+  uint8_t maxWindow;
+  uint8_t quietChanges;
+  uint8_t recentBounce;
+  uint8_t measured;
+};
+
+// Size of the report written by write_input_filter_report(): report ID,
+// timer tick in microseconds, debounce tick in microseconds (16 bits),
+// then for each of the 8 inputs of the state byte, bit 0 first: changes,
+// chatter and longest bounce in timer ticks (16 bits each), escapes and
+// current window in debounce ticks, little-endian.
+#define INPUT_FILTER_REPORT_SIZE (4 + 8 * 8)
 
 struct InputFilter
 {
   // Stores the state for each bit that was trusted as valid/stable input.
   uint8_t lastTrustedInputBits[NUM_CONTROLLER_STATE_BYTES];
 
-  // Stores the previous state for each bit of input.
-  uint8_t lastInputBits[NUM_CONTROLLER_STATE_BYTES];
+  // Stores the bits that were counting on the previous pass.  Only these
+  // bits are credited with the time since that pass.
+  uint8_t pendingInputBits[NUM_CONTROLLER_STATE_BYTES];
+
+  // Stores the bits that reported an eager edge and are still inside their
+  // lockout window.
+  uint8_t lockedInputBits[NUM_CONTROLLER_STATE_BYTES];
+
+  // Stores the number of debounce ticks each input bit has differed from
+  // its trusted state, or has been locked out, one bit plane per counter
+  // bit.  A debounce counter is cleared as soon as the raw input agrees
+  // with the trusted state again.
+  uint8_t inputBitStabilityCounter[NUM_CONTROLLER_STATE_BYTES][STABILITY_COUNTER_BITS];
+
+  // Stores the debounce window of each input bit in debounce ticks, in the
+  // same bit-sliced layout as the counters.
+  uint8_t inputBitStabilityThreshold[NUM_CONTROLLER_STATE_BYTES][STABILITY_COUNTER_BITS];
+
+  // Masks that select eager filtering for presses and releases, either
+  // 0x00 or 0xFF.
+  uint8_t eagerPressMask;
+  uint8_t eagerReleaseMask;
+
+  // Timestamp of the start of the current debounce tick.
+  uint16_t tickStartTime;
 
-  // Stores the number of times each input bit has matched the previous
-  // input bit state.  A value of 0xFF means the current bit value
-  // has not changed and is valid.
-  uint8_t inputBitStabilityCounter[NUM_CONTROLLER_STATE_BYTES][BITS_PER_BYTE];
+  // Stores the debounced bits that were counting on the previous pass, the
+  // bits in a bounce episode that has not been committed, and the bits
+  // committed less than their upper bound ago.
+  uint8_t debouncingInputBits[NUM_CONTROLLER_STATE_BYTES];
+  uint8_t bouncingInputBits[NUM_CONTROLLER_STATE_BYTES];
+  uint8_t settlingInputBits[NUM_CONTROLLER_STATE_BYTES];
+
+  // Bounce statistics, indexed by state byte * 8 + bit.
+  struct InputChatter chatter[NUM_CONTROLLER_STATE_BYTES * BITS_PER_BYTE];
+
+  // Statistics of each state byte as last published for the report, and
+  // the state bytes whose statistics changed since.  The filter publishes
+  // at most once per debounce tick, and the USB interrupt reads the
+  // current copy without either side disabling interrupts.
+  struct InputBounceStats publishedStats[NUM_CONTROLLER_STATE_BYTES][2][BITS_PER_BYTE];
+  struct SeqBuffer statsBuffer[NUM_CONTROLLER_STATE_BYTES];
+  uint8_t unpublishedStats;
+
+  // Set if the windows adapt to the measured bounce.
+  uint8_t adaptive;
 };
 
-// Initializes the passed in input filter.
+// Initializes the passed in input filter with the windows and modes in
+// the config store.
 void init_input_filter(struct InputFilter* inputFilter);
 
+// Sets the debounce window, in microseconds, of the inputs selected by
+// 'mask' in state byte 'stateByte'.
+void set_input_filter_window(struct InputFilter* inputFilter, uint8_t stateByte, uint8_t mask, uint16_t windowUs);
+
+// Enables or disables adaptive windows.  Disabling puts every input back
+// on the window set for it.
+void set_input_filter_adaptive(struct InputFilter* inputFilter, uint8_t adaptive);
+
+// Selects how presses and releases are filtered.
+void set_input_filter_mode(struct InputFilter* inputFilter, enum InputFilterMode pressMode, enum InputFilterMode releaseMode);
+
 // Takes the raw input bit data and filters it, then overwrites the inputBits array with
 // the result.
 void filter_input(struct InputFilter* inputFilter, uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES]);
 
+// Same as filter_input(), for input bits sampled at the given timer.h
+// timestamp instead of now.  Samples should be passed in time order; a
+// sample slightly older than the previous one is filtered as if no time
+// passed.
+void filter_input_at(struct InputFilter* inputFilter, uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES], uint16_t timestamp);
+
+// Writes the last published bounce statistics of the inputs in
+// 'stateByte' of the filter initialized last as a feature report with ID
+// 'reportId' into 'report', and returns its size, or 0 if there is no
+// such state byte.  Can be called from an interrupt handler.
+uint8_t write_input_filter_report(uint8_t stateByte, uint8_t reportId, uint8_t report[INPUT_FILTER_REPORT_SIZE]);
+
 #endif //#ifndef __INPUT_FILTER__
\ No newline at end of file
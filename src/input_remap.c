@@ -0,0 +1,122 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <avr/pgmspace.h>
+#include "input_remap.h"
+#include "config_store.h"
+
+// Bit number of a single-bit mask.
+#define BIT_INDEX(mask) ((((mask) & 0xAA) ? 1 : 0) | (((mask) & 0xCC) ? 2 : 0) | (((mask) & 0xF0) ? 4 : 0))
+#define INPUT_INDEX(byte, mask) ((byte) * BITS_PER_BYTE + BIT_INDEX(mask))
+
+// Layout wired in pins.h.
+static const uint8_t PROGMEM defaultOutputs[REMAP_NUM_INPUTS] =
+{
+  [INPUT_INDEX(0, B_05)] = REMAP_BUTTON_05,
+  [INPUT_INDEX(0, B_06)] = REMAP_BUTTON_06,
+  [INPUT_INDEX(0, B_07)] = REMAP_BUTTON_07,
+  [INPUT_INDEX(0, B_08)] = REMAP_BUTTON_08,
+  [INPUT_INDEX(0, B_09)] = REMAP_BUTTON_09,
+  [INPUT_INDEX(0, B_10)] = REMAP_BUTTON_10,
+  [INPUT_INDEX(0, B_11)] = REMAP_BUTTON_11,
+  [INPUT_INDEX(0, B_12)] = REMAP_BUTTON_12,
+  [INPUT_INDEX(1, D_LT)] = REMAP_LEFT,
+  [INPUT_INDEX(1, D_RT)] = REMAP_RIGHT,
+  [INPUT_INDEX(1, D_UP)] = REMAP_UP,
+  [INPUT_INDEX(1, D_DN)] = REMAP_DOWN,
+  [INPUT_INDEX(1, B_01)] = REMAP_BUTTON_01,
+  [INPUT_INDEX(1, B_02)] = REMAP_BUTTON_02,
+  [INPUT_INDEX(1, B_03)] = REMAP_BUTTON_03,
+  [INPUT_INDEX(1, B_04)] = REMAP_BUTTON_04,
+#if NUM_CONTROLLER_STATE_BYTES > 2
+  [2 * BITS_PER_BYTE ... REMAP_NUM_INPUTS - 1] = REMAP_NONE
+#endif
+};
+
+// Axis values for each combination of the four direction outputs
+// (bit 0 left, bit 1 right, bit 2 up, bit 3 down).  Left wins over right
+// and up wins over down.
+#define AXIS_X(d) (((d) & 1) ? DIR_LEFT : (((d) & 2) ? DIR_RIGHT : DIR_NULL))
+#define AXIS_Y(d) (((d) & 4) ? DIR_UP : (((d) & 8) ? DIR_DOWN : DIR_NULL))
+#define AXES(d) {AXIS_X(d), AXIS_Y(d)}
+static const uint8_t PROGMEM directionAxes[16][2] =
+{
+  AXES(0), AXES(1), AXES(2), AXES(3), AXES(4), AXES(5), AXES(6), AXES(7),
+  AXES(8), AXES(9), AXES(10), AXES(11), AXES(12), AXES(13), AXES(14), AXES(15)
+};
+
+void init_input_remap(struct InputRemap* inputRemap)
+{
+  set_input_remap(inputRemap, get_config()->remap);
+}
+
+void get_default_input_remap(uint8_t outputs[REMAP_NUM_INPUTS])
+{
+  memcpy_P(outputs, defaultOutputs, REMAP_NUM_INPUTS);
+}
+
+void set_input_remap(struct InputRemap* inputRemap, const uint8_t outputs[REMAP_NUM_INPUTS])
+{
+  for (uint8_t n = 0; n < REMAP_NUM_NIBBLES; ++n)
+  {
+    for (uint8_t value = 0; value < 16; ++value)
+    {
+      uint16_t mask = 0;
+      for (uint8_t j = 0; j < 4; ++j)
+      {
+        uint8_t output = outputs[n * 4 + j];
+        if ((value & (1<<j)) && output <= REMAP_DOWN)
+        {
+          mask |= (1 << output);
+        }
+      }
+      inputRemap->nibbleLookup[n][value] = mask;
+    }
+  }
+
+  for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+  {
+    inputRemap->outputs[i] = outputs[i];
+  }
+}
+
+void remap_input(const struct InputRemap* inputRemap, const uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES],
+  uint8_t* x, uint8_t* y, uint8_t buttons[2])
+{
+  uint16_t mask = 0;
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    mask |= inputRemap->nibbleLookup[i * 2][inputBits[i] & 0x0F];
+    mask |= inputRemap->nibbleLookup[i * 2 + 1][inputBits[i] >> 4];
+  }
+
+  uint8_t directions = (mask >> REMAP_LEFT) & 0x0F;
+  *x = pgm_read_byte(&directionAxes[directions][0]);
+  *y = pgm_read_byte(&directionAxes[directions][1]);
+  buttons[0] = mask & 0xFF;
+  buttons[1] = (mask >> 8) & 0x0F;
+}
@@ -0,0 +1,93 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __INPUT_REMAP__
+#define __INPUT_REMAP__
+
+#include "pins.h"
+#include "macros.h"
+#include <stdint.h>
+
+// Maps filtered controller state bits to USB axes and buttons.  Any
+// physical input can drive any USB button or joystick direction.  The
+// mapping is turned into one lookup table per state nibble, so remapping
+// costs the same handful of table reads whatever the layout is.
+
+// Number of physical inputs that can be mapped.
+#define REMAP_NUM_INPUTS (NUM_CONTROLLER_STATE_BYTES * BITS_PER_BYTE)
+
+// Number of state nibbles, one lookup table each.
+#define REMAP_NUM_NIBBLES (NUM_CONTROLLER_STATE_BYTES * 2)
+
+// USB outputs a physical input can be mapped to.
+enum RemapOutput
+{
+  REMAP_BUTTON_01 = 0,
+  REMAP_BUTTON_02,
+  REMAP_BUTTON_03,
+  REMAP_BUTTON_04,
+  REMAP_BUTTON_05,
+  REMAP_BUTTON_06,
+  REMAP_BUTTON_07,
+  REMAP_BUTTON_08,
+  REMAP_BUTTON_09,
+  REMAP_BUTTON_10,
+  REMAP_BUTTON_11,
+  REMAP_BUTTON_12,
+  REMAP_LEFT,
+  REMAP_RIGHT,
+  REMAP_UP,
+  REMAP_DOWN,
+  REMAP_NONE = 0xFF
+};
+
+struct InputRemap
+{
+  // Stores the USB output (enum RemapOutput) of each physical input,
+  // indexed by state byte * 8 + bit number.
+  uint8_t outputs[REMAP_NUM_INPUTS];
+
+  // Stores, for each state nibble and each value of that nibble, the USB
+  // outputs it drives as a bit mask of (1 << enum RemapOutput).
+  uint16_t nibbleLookup[REMAP_NUM_NIBBLES][16];
+};
+
+// Initializes the remap stage from the layout in the config store.
+void init_input_remap(struct InputRemap* inputRemap);
+
+// Copies the default layout, as wired in pins.h, into 'outputs'.
+void get_default_input_remap(uint8_t outputs[REMAP_NUM_INPUTS]);
+
+// Replaces the layout and rebuilds the lookup tables.
+void set_input_remap(struct InputRemap* inputRemap, const uint8_t outputs[REMAP_NUM_INPUTS]);
+
+// Converts filtered controller state bits to USB axis values and button
+// bytes.
+void remap_input(const struct InputRemap* inputRemap, const uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES],
+  uint8_t* x, uint8_t* y, uint8_t buttons[2]);
+
+#endif //#ifndef __INPUT_REMAP__
@@ -0,0 +1,197 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "latency_stats.h"
+#include "seq_buffer.h"
+#include "timer.h"
+
+// A change still waiting for the filter is forgotten once the raw input
+// has agreed with the filter's output again for longer than the longest
+// debounce window, so a glitch is not charged to the next change.
+#define LATENCY_STALE_TICKS TIMER_US_TO_TICKS(16000)
+
+struct LatencyHistogram
+{
+  uint16_t count;
+  uint16_t min;
+  uint16_t max;
+  uint32_t total;
+  uint16_t buckets[LATENCY_BUCKETS];
+};
+
+struct LatencyTrace
+{
+  uint16_t sampleTime;
+  uint16_t commitTime;
+  uint16_t publishTime;
+};
+
+// Main loop side: the filter's last output, and the change being timed.
+static uint8_t filteredInputBits[NUM_CONTROLLER_STATE_BYTES];
+static uint16_t changeStartTime;
+static uint8_t changeStarted = 0;
+static struct LatencyTrace committedTrace;
+static uint8_t traceCommitted = 0;
+
+// Published traces, handed to the report commit interrupt.  It handles
+// each sequence number once.
+static struct LatencyTrace traces[2];
+static struct SeqBuffer traceBuffer = SEQ_BUFFER_INIT(traces);
+static uint8_t handledSequence = 0;
+
+static struct LatencyHistogram histograms[LATENCY_STAGE_COUNT];
+
+static uint8_t differs_from_filtered(const uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES])
+{
+  uint8_t difference = 0;
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    difference |= inputBits[i] ^ filteredInputBits[i];
+  }
+  return difference;
+}
+
+void latency_mark_sample(const uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES], uint16_t timestamp)
+{
+  if (differs_from_filtered(inputBits))
+  {
+    if (!changeStarted)
+    {
+      changeStartTime = timestamp;
+      changeStarted = 1;
+    }
+  }
+  else if (changeStarted && (uint16_t)(timestamp - changeStartTime) > LATENCY_STALE_TICKS)
+  {
+    changeStarted = 0;
+  }
+}
+
+void latency_mark_commit(const uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES], uint16_t timestamp)
+{
+  if (!differs_from_filtered(inputBits))
+  {
+    return;
+  }
+
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    filteredInputBits[i] = inputBits[i];
+  }
+  committedTrace.sampleTime = changeStarted ? changeStartTime : timestamp;
+  committedTrace.commitTime = timestamp;
+  traceCommitted = 1;
+  changeStarted = 0;
+}
+
+void latency_mark_publish(uint16_t timestamp)
+{
+  if (!traceCommitted)
+  {
+    return;
+  }
+
+  struct LatencyTrace* trace = seq_buffer_next(&traceBuffer);
+  *trace = committedTrace;
+  trace->publishTime = timestamp;
+  seq_buffer_publish(&traceBuffer);
+  traceCommitted = 0;
+}
+
+static void add_latency(struct LatencyHistogram* histogram, uint16_t ticks)
+{
+  uint8_t bucket = 0;
+  for (uint16_t rest = ticks; rest && bucket < LATENCY_BUCKETS - 1; rest >>= 1)
+  {
+    ++bucket;
+  }
+
+  if (histogram->count == 0 || ticks < histogram->min)
+  {
+    histogram->min = ticks;
+  }
+  if (ticks > histogram->max)
+  {
+    histogram->max = ticks;
+  }
+  if (histogram->count < 0xFFFF)
+  {
+    ++histogram->count;
+    histogram->total += ticks;
+  }
+  if (histogram->buckets[bucket] < 0xFFFF)
+  {
+    ++histogram->buckets[bucket];
+  }
+}
+
+void latency_mark_handoff(uint8_t changed, uint16_t timestamp)
+{
+  uint8_t sequence = traceBuffer.sequence;
+  if (sequence == handledSequence)
+  {
+    return;
+  }
+  handledSequence = sequence;
+  if (!changed)
+  {
+    return;
+  }
+
+  // The main loop cannot run here, so the current trace is stable.
+  const struct LatencyTrace* trace = seq_buffer_current(&traceBuffer);
+  add_latency(&histograms[LATENCY_FILTER], trace->commitTime - trace->sampleTime);
+  add_latency(&histograms[LATENCY_PUBLISH], trace->publishTime - trace->commitTime);
+  add_latency(&histograms[LATENCY_HANDOFF], timestamp - trace->publishTime);
+  add_latency(&histograms[LATENCY_TOTAL], timestamp - trace->sampleTime);
+}
+
+static uint8_t* put_16(uint8_t* p, uint16_t value)
+{
+  p[0] = value;
+  p[1] = value >> 8;
+  return p + 2;
+}
+
+uint8_t write_latency_report(uint8_t stage, uint8_t reportId, uint8_t report[LATENCY_REPORT_SIZE])
+{
+  const struct LatencyHistogram* histogram = &histograms[stage];
+  uint8_t* p = report;
+
+  *p++ = reportId;
+  *p++ = TIMER_US_PER_TICK;
+  p = put_16(p, histogram->count);
+  p = put_16(p, histogram->min);
+  p = put_16(p, histogram->max);
+  p = put_16(p, histogram->total);
+  p = put_16(p, histogram->total >> 16);
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; ++i)
+  {
+    p = put_16(p, histogram->buckets[i]);
+  }
+  return p - report;
+}
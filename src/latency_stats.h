@@ -0,0 +1,87 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __LATENCY_STATS__
+#define __LATENCY_STATS__
+
+#include "pins.h"
+#include <stdint.h>
+
+// Latency telemetry for the input path.  An input change is traced with
+// timer.h timestamps at four points: when it was first sampled, when the
+// input filter commits it, when the main loop publishes the report that
+// carries it, and when that report is handed to the USB endpoint.  The
+// time between each pair of points, and in total, is kept in a histogram
+// with min, max and mean, and read back as a vendor feature report (see
+// usb_gamepad.h).
+//
+// The first three points are marked by the main loop, the last by the
+// report commit interrupt, and the histograms are only written there.
+
+enum LatencyStage
+{
+  LATENCY_FILTER,   // sampled to committed by the filter
+  LATENCY_PUBLISH,  // committed to published
+  LATENCY_HANDOFF,  // published to handed to the endpoint
+  LATENCY_TOTAL,    // sampled to handed to the endpoint
+  LATENCY_STAGE_COUNT
+};
+
+// Histogram buckets.  Bucket 0 counts zero-tick latencies and bucket n
+// those of 2^(n-1) to 2^n - 1 timer ticks; the last one also takes
+// everything longer.
+#define LATENCY_BUCKETS 14
+
+// Size of the report written by write_latency_report(): report ID, timer
+// tick in microseconds, sample count, min and max in ticks (16 bits
+// each), total in ticks (32 bits) and the bucket counts (16 bits each),
+// little-endian.  Counts stop at 0xFFFF.
+#define LATENCY_REPORT_SIZE (10 + 2 * LATENCY_BUCKETS)
+
+// Main loop: a raw sample of the inputs, taken at 'timestamp', before it
+// is filtered.  Starts timing a change when it differs from the filter's
+// last output.
+void latency_mark_sample(const uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES], uint16_t timestamp);
+
+// Main loop: the filter's output at 'timestamp'.  A change from its last
+// output is the change being traced.
+void latency_mark_commit(const uint8_t inputBits[NUM_CONTROLLER_STATE_BYTES], uint16_t timestamp);
+
+// Main loop: the report was published at 'timestamp'.
+void latency_mark_publish(uint16_t timestamp);
+
+// Report commit interrupt: a report was due at 'timestamp'.  'changed' is
+// set if a report that differs from the previous one was handed to the
+// endpoint; otherwise the traced change did not alter the report and is
+// dropped.
+void latency_mark_handoff(uint8_t changed, uint16_t timestamp);
+
+// Writes the histogram of 'stage' as a feature report with ID 'reportId'
+// into 'report' and returns its size.  Call with interrupts disabled.
+uint8_t write_latency_report(uint8_t stage, uint8_t reportId, uint8_t report[LATENCY_REPORT_SIZE]);
+
+#endif //#ifndef __LATENCY_STATS__
@@ -0,0 +1,167 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <avr/io.h>
+#include "loop_monitor.h"
+#include "seq_buffer.h"
+#include "timer.h"
+
+struct LoopWindow
+{
+  uint16_t frames;
+  uint32_t passes;
+  uint16_t minFramePasses;
+  uint16_t maxFramePasses;
+  uint16_t maxPassTicks;
+  uint8_t maxPassFrame;
+  uint16_t maxIrqTicks;
+  uint8_t maxIrqFrame;
+  uint8_t maxIrqSource;
+};
+
+// Window being counted by the main loop.
+static struct LoopWindow window = {0, 0, 0xFFFF, 0, 0, 0, 0, 0, LOOP_IRQ_NONE};
+static uint16_t framePasses = 0;
+static uint8_t lastFrame = 0;
+static uint16_t lastPassTime = 0;
+
+// Longest time with interrupts disabled since the main loop last took it
+// over.  Only written with interrupts disabled, by interrupt handlers,
+// which do not nest, and at the end of atomic sections.
+static volatile uint16_t maxIrqTicks = 0;
+static volatile uint8_t maxIrqFrame = 0;
+static volatile uint8_t maxIrqSource = LOOP_IRQ_NONE;
+
+// Complete windows, handed to the control endpoint.
+static struct LoopWindow windows[2];
+static struct SeqBuffer windowBuffer = SEQ_BUFFER_INIT(windows);
+
+static void close_window(void)
+{
+  LOOP_ATOMIC_BLOCK(LOOP_ATOMIC_MONITOR)
+  {
+    window.maxIrqTicks = maxIrqTicks;
+    window.maxIrqFrame = maxIrqFrame;
+    window.maxIrqSource = maxIrqSource;
+    maxIrqTicks = 0;
+    maxIrqSource = LOOP_IRQ_NONE;
+  }
+
+  struct LoopWindow* next = seq_buffer_next(&windowBuffer);
+  *next = window;
+  seq_buffer_publish(&windowBuffer);
+
+  window.frames = 0;
+  window.passes = 0;
+  window.minFramePasses = 0xFFFF;
+  window.maxFramePasses = 0;
+  window.maxPassTicks = 0;
+}
+
+void loop_monitor_pass(void)
+{
+  uint16_t now = timer_now();
+  uint16_t passTicks = now - lastPassTime;
+  uint8_t frame = UDFNUML;
+  lastPassTime = now;
+
+  ++framePasses;
+  ++window.passes;
+  if (passTicks > window.maxPassTicks)
+  {
+    window.maxPassTicks = passTicks;
+    window.maxPassFrame = frame;
+  }
+
+  uint8_t frames = frame - lastFrame;
+  if (frames == 0)
+  {
+    return;
+  }
+  lastFrame = frame;
+
+  // The passes so far belong to the frame that just ended.  If more than
+  // one frame went by, the ones in between had no pass at all.
+  if (frames > 1)
+  {
+    window.minFramePasses = 0;
+  }
+  if (framePasses < window.minFramePasses)
+  {
+    window.minFramePasses = framePasses;
+  }
+  if (framePasses > window.maxFramePasses)
+  {
+    window.maxFramePasses = framePasses;
+  }
+  framePasses = 0;
+
+  window.frames += frames;
+  if (window.frames >= LOOP_WINDOW_FRAMES)
+  {
+    close_window();
+  }
+}
+
+void loop_monitor_irq(uint8_t source, uint16_t startTime)
+{
+  uint16_t ticks = TCNT1 - startTime;
+  if (ticks > maxIrqTicks)
+  {
+    maxIrqTicks = ticks;
+    maxIrqFrame = UDFNUML;
+    maxIrqSource = source;
+  }
+}
+
+static uint8_t* put_16(uint8_t* p, uint16_t value)
+{
+  p[0] = value;
+  p[1] = value >> 8;
+  return p + 2;
+}
+
+uint8_t write_loop_report(uint8_t reportId, uint8_t report[LOOP_REPORT_SIZE])
+{
+  // The main loop cannot run here, so the current window is stable.
+  const struct LoopWindow* last = seq_buffer_current(&windowBuffer);
+  uint8_t* p = report;
+
+  *p++ = reportId;
+  *p++ = TIMER_US_PER_TICK;
+  p = put_16(p, last->frames);
+  p = put_16(p, last->passes);
+  p = put_16(p, last->passes >> 16);
+  p = put_16(p, last->frames ? last->minFramePasses : 0);
+  p = put_16(p, last->maxFramePasses);
+  p = put_16(p, last->maxPassTicks);
+  *p++ = last->maxPassFrame;
+  p = put_16(p, last->maxIrqTicks);
+  *p++ = last->maxIrqFrame;
+  *p++ = last->maxIrqSource;
+  return p - report;
+}
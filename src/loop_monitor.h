@@ -0,0 +1,89 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __LOOP_MONITOR__
+#define __LOOP_MONITOR__
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <stdint.h>
+
+// Lightweight profiler for the main loop and the interrupt handlers.
+// Over windows of LOOP_WINDOW_FRAMES USB frames it counts main loop
+// passes, the fewest and most passes in one frame, the longest single
+// pass, and the longest time spent with interrupts disabled, either in
+// an interrupt handler or in a LOOP_ATOMIC_BLOCK of the main loop, with
+// the frame number (UDFNUML) each maximum was seen in.  The last
+// complete window is read back as a vendor feature report (see
+// usb_gamepad.h).
+//
+// Windows only advance while the host sends start-of-frame packets.
+
+// Frames per window, a power of two so it lines up with UDFNUML.
+#define LOOP_WINDOW_FRAMES 256
+
+// Interrupt handlers and atomic sections that are timed.
+enum LoopMonitorSource
+{
+  LOOP_IRQ_NONE,
+  LOOP_IRQ_USB_GEN,
+  LOOP_IRQ_USB_COM,
+  LOOP_IRQ_REPORT_TIMER,
+  LOOP_ATOMIC_TIMER,
+  LOOP_ATOMIC_MONITOR,
+  LOOP_ATOMIC_TUNING
+};
+
+// Size of the report written by write_loop_report(): report ID, timer
+// tick in microseconds, frames in the window (16 bits), main loop passes
+// (32 bits), fewest and most passes in a frame (16 bits each), longest
+// pass in ticks (16 bits) and its frame, longest time with interrupts
+// disabled in ticks (16 bits), its frame and its LoopMonitorSource,
+// little-endian.
+#define LOOP_REPORT_SIZE 19
+
+// Main loop: called once per pass.
+void loop_monitor_pass(void);
+
+// Interrupt handlers: called on the way out, with the TCNT1 value read on
+// the way in.  Also called with interrupts disabled at the end of a
+// LOOP_ATOMIC_BLOCK.
+void loop_monitor_irq(uint8_t source, uint16_t startTime);
+
+// ATOMIC_BLOCK(ATOMIC_RESTORESTATE) that is timed like an interrupt
+// handler, as 'source'.  Leaving the block with break or return skips
+// the measurement.
+#define LOOP_ATOMIC_BLOCK(source) \
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) \
+    for (uint16_t __loop_start = TCNT1, __loop_todo = 1; __loop_todo; \
+         __loop_todo = 0, loop_monitor_irq((source), __loop_start))
+
+// Writes the last complete window as a feature report with ID 'reportId'
+// into 'report' and returns its size.  Call with interrupts disabled.
+uint8_t write_loop_report(uint8_t reportId, uint8_t report[LOOP_REPORT_SIZE]);
+
+#endif //#ifndef __LOOP_MONITOR__
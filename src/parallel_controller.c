@@ -26,40 +26,179 @@
 
 #include <avr/io.h>
 #include <avr/pgmspace.h>
+#include <avr/interrupt.h>
 #include "parallel_controller.h"
 #include "macros.h"
 
+// Input ports, as used in PARALLEL_PIN_MAP.
+#define INPUT_PORT_B 0
+#define INPUT_PORT_C 1
+#define INPUT_PORT_D 2
+#define INPUT_PORT_F 3
+
+// Board wiring.  Each entry is MAP(port, pin, state byte, state bit) for
+// one active-low input with the internal pull-up enabled.  Everything
+// else in this file (pull-ups, interrupt masks and the state bit
+// shuffle) is derived from this table.
+#define PARALLEL_PIN_MAP(MAP) \
+  MAP(INPUT_PORT_F, PIN_07, 0, B_05) \
+  MAP(INPUT_PORT_B, PIN_06, 0, B_06) \
+  MAP(INPUT_PORT_B, PIN_05, 0, B_07) \
+  MAP(INPUT_PORT_B, PIN_04, 0, B_08) \
+  MAP(INPUT_PORT_D, PIN_02, 0, B_09) \
+  MAP(INPUT_PORT_D, PIN_03, 0, B_10) \
+  MAP(INPUT_PORT_D, PIN_07, 0, B_11) \
+  MAP(INPUT_PORT_F, PIN_00, 1, D_UP) \
+  MAP(INPUT_PORT_F, PIN_01, 1, D_DN) \
+  MAP(INPUT_PORT_F, PIN_04, 1, D_LT) \
+  MAP(INPUT_PORT_F, PIN_05, 1, D_RT) \
+  MAP(INPUT_PORT_B, PIN_03, 1, B_01) \
+  MAP(INPUT_PORT_B, PIN_07, 1, B_02) \
+  MAP(INPUT_PORT_C, PIN_06, 1, B_03) \
+  MAP(INPUT_PORT_F, PIN_06, 1, B_04)
+
+// Input pin masks for each port.
+#define PORT_PIN_MASK(port, target, pin) ((port) == (target) ? (pin) : 0)
+#define PIN_MASK_B(port, pin, byte, bit) | PORT_PIN_MASK(port, INPUT_PORT_B, pin)
+#define PIN_MASK_C(port, pin, byte, bit) | PORT_PIN_MASK(port, INPUT_PORT_C, pin)
+#define PIN_MASK_D(port, pin, byte, bit) | PORT_PIN_MASK(port, INPUT_PORT_D, pin)
+#define PIN_MASK_F(port, pin, byte, bit) | PORT_PIN_MASK(port, INPUT_PORT_F, pin)
+#define INPUT_PINS_B (0 PARALLEL_PIN_MAP(PIN_MASK_B))
+#define INPUT_PINS_C (0 PARALLEL_PIN_MAP(PIN_MASK_C))
+#define INPUT_PINS_D (0 PARALLEL_PIN_MAP(PIN_MASK_D))
+#define INPUT_PINS_F (0 PARALLEL_PIN_MAP(PIN_MASK_F))
+
+// Input pins that can raise an interrupt on every edge: all of PORTB
+// (PCINT0-7) and PD0-PD3 (INT0-3).  The remaining inputs are only polled.
+#define CAPTURE_PINS_B INPUT_PINS_B
+#define CAPTURE_PINS_D (INPUT_PINS_D & (PIN_00 | PIN_01 | PIN_02 | PIN_03))
+
+// EICRA value selecting "any edge" for each INTn in CAPTURE_PINS_D.
+#define CAPTURE_EICRA (((CAPTURE_PINS_D & PIN_00) << 0) | ((CAPTURE_PINS_D & PIN_01) << 1) | \
+                       ((CAPTURE_PINS_D & PIN_02) << 2) | ((CAPTURE_PINS_D & PIN_03) << 3))
+
+// Moves the bit selected by mask 'from' in 'value' to the position of mask
+// 'to'.  Both masks are compile-time constants, so this turns into a mask
+// and a constant shift with no branches.
+#define MOVE_BIT(value, from, to) \
+  ((from) >= (to) ? (((value) & (from)) / ((from) / (to))) : (((value) & (from)) * ((to) / (from))))
+
+// Ring buffer of captured edges.  The pin change interrupts are the only
+// producer and the main loop is the only consumer, so the head index is
+// only written by the interrupt handlers and the tail index only by
+// get_controller_edge_parallel().  The size must be a power of two.
+#define EDGE_BUFFER_SIZE 16
+#define EDGE_BUFFER_MASK (EDGE_BUFFER_SIZE - 1)
+
+struct EdgeRecord
+{
+  uint16_t timestamp;
+  uint8_t portB;
+  uint8_t portD;
+};
+
+static struct EdgeRecord edgeBuffer[EDGE_BUFFER_SIZE];
+static volatile uint8_t edgeBufferHead = 0;
+static volatile uint8_t edgeBufferTail = 0;
+
+// PORTC and PORTF as of the last get_controller_state_parallel(), for the
+// inputs that have no pin change interrupt.
+static uint8_t lastPortC = 0xFF;
+static uint8_t lastPortF = 0xFF;
+
 void init_controller_parallel(void)
 {
-  DDRB |= PORT_CONFIG_INPUT; // Configure PortB as an input port
-  DDRC |= PORT_CONFIG_INPUT; // Configure PortC as an input port
-  DDRD |= PORT_CONFIG_INPUT; // Configure PortD as an input port
-  DDRF |= PORT_CONFIG_INPUT; // Configure PortF as an input port
-  PORTB |= (PIN_03 | PIN_04 | PIN_05 | PIN_06 | PIN_07); // Enable internal pull-up resistors
-  PORTC |= (PIN_06);
-  PORTD |= (PIN_02 | PIN_03 | PIN_07);
-  PORTF |= (PIN_00 | PIN_01 | PIN_04 | PIN_05 | PIN_06 | PIN_07);
+  DDRB &= ~INPUT_PINS_B; // Configure the input pins as inputs
+  DDRC &= ~INPUT_PINS_C;
+  DDRD &= ~INPUT_PINS_D;
+  DDRF &= ~INPUT_PINS_F;
+  PORTB |= INPUT_PINS_B; // Enable internal pull-up resistors
+  PORTC |= INPUT_PINS_C;
+  PORTD |= INPUT_PINS_D;
+  PORTF |= INPUT_PINS_F;
+
+  // Interrupt on any edge of the capture pins.
+  PCMSK0 = CAPTURE_PINS_B;
+  PCIFR = (1<<PCIF0);
+  PCICR |= (1<<PCIE0);
+  EICRA = CAPTURE_EICRA;
+  EIFR = CAPTURE_PINS_D;
+  EIMSK |= CAPTURE_PINS_D;
+}
+
+// Builds the state bytes from one snapshot of the (inverted, so a set bit
+// is a pressed input) port registers.
+#define MAP_INPUT_PIN(port, pin, byte, bit) pins[byte] |= MOVE_BIT(ports[port], pin, bit);
+static inline void get_controller_state_from_ports(uint8_t pins[NUM_CONTROLLER_STATE_BYTES], const uint8_t ports[4])
+{
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    pins[i] = 0;
+  }
+  PARALLEL_PIN_MAP(MAP_INPUT_PIN)
 }
 
 void get_controller_state_parallel(uint8_t pins[NUM_CONTROLLER_STATE_BYTES])
 {
-  pins[0] = 0;
-  pins[1] = 0;
-
-  pins[0] |= (PINF & PIN_07) ? 0 : B_05;
-  pins[0] |= (PINB & PIN_06) ? 0 : B_06;
-  pins[0] |= (PINB & PIN_05) ? 0 : B_07;
-  pins[0] |= (PINB & PIN_04) ? 0 : B_08;
-  pins[0] |= (PIND & PIN_02) ? 0 : B_09;
-  pins[0] |= (PIND & PIN_03) ? 0 : B_10;
-  pins[0] |= (PIND & PIN_07) ? 0 : B_11;
-
-  pins[1] |= (PINF & PIN_00) ? 0 : D_UP;
-  pins[1] |= (PINF & PIN_01) ? 0 : D_DN;
-  pins[1] |= (PINF & PIN_04) ? 0 : D_LT;
-  pins[1] |= (PINF & PIN_05) ? 0 : D_RT;
-  pins[1] |= (PINB & PIN_03) ? 0 : B_01;
-  pins[1] |= (PINB & PIN_07) ? 0 : B_02;
-  pins[1] |= (PINC & PIN_06) ? 0 : B_03;
-  pins[1] |= (PINF & PIN_06) ? 0 : B_04;
+  // Latch every port exactly once, back to back, so the sample is
+  // coherent.
+  uint8_t ports[4];
+  ports[INPUT_PORT_B] = ~PINB;
+  lastPortC = PINC;
+  ports[INPUT_PORT_D] = ~PIND;
+  lastPortF = PINF;
+  ports[INPUT_PORT_C] = ~lastPortC;
+  ports[INPUT_PORT_F] = ~lastPortF;
+
+  get_controller_state_from_ports(pins, ports);
+}
+
+uint8_t get_controller_edge_parallel(uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp)
+{
+  uint8_t tail = edgeBufferTail;
+  if (tail == edgeBufferHead)
+  {
+    return 0;
+  }
+
+  // The producer never writes the slot at the tail, so it can be read
+  // without masking interrupts.  Inputs without a pin change interrupt
+  // keep the state they had in the last poll; reading them now would
+  // pair a later state with the edge's older timestamp.
+  const struct EdgeRecord* record = &edgeBuffer[tail];
+  uint8_t ports[4];
+  ports[INPUT_PORT_B] = ~record->portB;
+  ports[INPUT_PORT_C] = ~lastPortC;
+  ports[INPUT_PORT_D] = ~record->portD;
+  ports[INPUT_PORT_F] = ~lastPortF;
+  *timestamp = record->timestamp;
+  get_controller_state_from_ports(pins, ports);
+  edgeBufferTail = (tail + 1) & EDGE_BUFFER_MASK;
+  return 1;
 }
+
+ISR(PCINT0_vect)
+{
+  uint8_t head = edgeBufferHead;
+  uint8_t next = (head + 1) & EDGE_BUFFER_MASK;
+
+  // When the buffer is full, overwrite the newest record instead of
+  // dropping the edge, so the final state of a burst is never lost.  The
+  // newest record is never the one the consumer is reading.
+  if (next == edgeBufferTail)
+  {
+    next = head;
+    head = (head - 1) & EDGE_BUFFER_MASK;
+  }
+
+  struct EdgeRecord* record = &edgeBuffer[head];
+  record->timestamp = TCNT1;
+  record->portB = PINB;
+  record->portD = PIND;
+  edgeBufferHead = next;
+}
+
+ISR(INT0_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT1_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT2_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT3_vect, ISR_ALIASOF(PCINT0_vect));
@@ -40,4 +40,11 @@ void init_controller_parallel(void);
 // Returns the state of joystick and buttons.
 void get_controller_state_parallel(uint8_t pins[NUM_CONTROLLER_STATE_BYTES]);
 
+// Pin change interrupts on PORTB and PORTD record the port state and a
+// timer.h timestamp at every edge, so short taps are seen even when the
+// main loop is busy.  Pops the oldest captured edge and returns 1 with the
+// state of joystick and buttons at that edge, or returns 0 if no edges are
+// pending.
+uint8_t get_controller_edge_parallel(uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp);
+
 #endif
@@ -31,7 +31,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "macros.h"
 #include "usb_gamepad.h"
 #include "controller.h"
+#include "config_store.h"
+#include "tuning.h"
 #include "input_filter.h"
+#include "input_remap.h"
+#include "latency_stats.h"
+#include "loop_monitor.h"
+#include "poll_rate.h"
+#include "timer.h"
 
 uint8_t pins[NUM_CONTROLLER_STATE_BYTES];
 
@@ -42,69 +49,83 @@ int main(void)
   LED_CONFIG;
   LED_ON;
 
-  /* Initialize the USB interface */
-  usb_init();
-  while (!usb_configured());
+  /* Start the free-running timestamp counter */
+  init_timer();
 
   struct Controller controller;
 
   struct InputFilter inputFilter;
 
+  struct InputRemap inputRemap;
+
+  /* Load the settings; everything below is configured from them */
+  init_config_store();
+  const struct Config* config = get_config();
+
   /* Initialize controller */
-  init_controller(&controller, PARALLEL_TYPE);
+  init_controller(&controller, config->controllerType);
 
   /* Initialize controller input filter */
   init_input_filter(&inputFilter);
 
+  /* Load the button layout */
+  init_input_remap(&inputRemap);
+
+  /* Let the pull-ups settle, then pick the polling rate from the buttons
+     held at power-on */
+  uint16_t settleStart = timer_now();
+  while ((uint16_t)(timer_now() - settleStart) < TIMER_US_TO_TICKS(1000))
+    ;
+  uint8_t bootX, bootY;
+  uint8_t bootButtons[2];
+  uint16_t bootTime;
+  get_controller_state(&controller, pins, &bootTime);
+  remap_input(&inputRemap, pins, &bootX, &bootY, bootButtons);
+  uint8_t pollRate = select_poll_rate(bootButtons);
+
+  /* Initialize the USB interface.  Enumeration runs from interrupts
+     while the main loop samples and filters the inputs, so the first
+     report is ready as soon as the host configures the device */
+  usb_init(config->profile, POLL_RATE_INTERVAL(pollRate));
+
   /* Main loop. */
   for(;;)
   {
-    /* Get the current input state of the controller */
-    get_controller_state(&controller, pins);
+    loop_monitor_pass();
+
+    /* Apply a tuning command from the host between two samples, and
+       write the next byte of a settings save, if one is pending */
+    tuning_poll(&inputFilter, &inputRemap);
+    config_store_poll();
+
+    /* Filter every input edge captured since the last pass, so short taps
+       are not missed while the loop is busy */
+    uint16_t edgeTime;
+    while (get_controller_edge(&controller, pins, &edgeTime))
+    {
+      latency_mark_sample(pins, edgeTime);
+      filter_input_at(&inputFilter, pins, edgeTime);
+    }
+
+    /* Get the current input state of the controller, stamped with the
+       time it was sampled */
+    uint16_t sampleTime;
+    get_controller_state(&controller, pins, &sampleTime);
+    latency_mark_sample(pins, sampleTime);
 
     /* Filter the raw input data */
-    filter_input(&inputFilter, pins);
-
-    /* Joystick motion */
-    uint8_t x = DIR_NULL;
-    uint8_t y = DIR_NULL;
-    if (pins[1] & D_LT)
-      x = DIR_LEFT;
-    else if (pins[1] & D_RT)
-      x = DIR_RIGHT;
-    if (pins[1] & D_UP)
-      y = DIR_UP;
-    else if (pins[1] & D_DN)
-      y = DIR_DOWN;
-
-    /* Button presses */
-    uint8_t b[2] = {0};
-    if (pins[1] & B_01)
-      b[0] |= BUTTON_01;
-    if (pins[1] & B_02)
-      b[0] |= BUTTON_02;
-    if (pins[1] & B_03)
-      b[0] |= BUTTON_03;
-    if (pins[1] & B_04)
-      b[0] |= BUTTON_04;
-    if (pins[0] & B_05)
-      b[0] |= BUTTON_05;
-    if (pins[0] & B_06)
-      b[0] |= BUTTON_06;
-    if (pins[0] & B_07)
-      b[0] |= BUTTON_07;
-    if (pins[0] & B_08)
-      b[0] |= BUTTON_08;
-    if (pins[0] & B_09)
-      b[1] |= BUTTON_09;
-    if (pins[0] & B_10)
-      b[1] |= BUTTON_10;
-    if (pins[0] & B_11)
-      b[1] |= BUTTON_11;
-    if (pins[0] & B_12)
-      b[1] |= BUTTON_12;
+    filter_input_at(&inputFilter, pins, sampleTime);
+    latency_mark_commit(pins, timer_now());
+
+    /* Map inputs to joystick motion and button presses */
+    uint8_t x, y;
+    uint8_t b[2];
+    remap_input(&inputRemap, pins, &x, &y, b);
 
+    /* Publish the state; the frame scheduler sends the latest one just
+       before the host reads it */
     usb_gamepad_action(x, y, b);
+    latency_mark_publish(timer_now());
     if (x != 128 || y != 128 || b[0] != 0 || b[1] != 0)
       LED_ON;
     else
@@ -27,8 +27,17 @@
 #ifndef __PINS_H__
 #define __PINS_H__
 
-/* Number of bytes to store controller state */
+/* Number of bytes to store controller state, 8 inputs each.  Set by
+   STATE_BYTES in the Makefile; the serial controller's chain is this many
+   registers long.  The bytes after the two below carry extra inputs,
+   unmapped until a layout assigns them.  The filter publishes its
+   statistics with one bit per byte, so there are at most 8. */
+#ifndef NUM_CONTROLLER_STATE_BYTES
 #define NUM_CONTROLLER_STATE_BYTES 2
+#endif
+#if NUM_CONTROLLER_STATE_BYTES < 2 || NUM_CONTROLLER_STATE_BYTES > 8
+#error "NUM_CONTROLLER_STATE_BYTES must be between 2 and 8"
+#endif
 
 /* First controller state byte's bit assignment */
 #define B_05 (1<<7)
@@ -50,6 +59,10 @@
 #define B_03 (1<<1)
 #define B_04 (1<<0)
 
+/* Joystick direction bits, debounced separately from the buttons */
+#define STICK_STATE_BYTE 1
+#define STICK_STATE_BITS (D_LT | D_RT | D_UP | D_DN)
+
 /* Axis values over USB */
 #define DIR_NULL (128)
 #define DIR_LEFT (0)
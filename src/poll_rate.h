@@ -0,0 +1,56 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __POLL_RATE__
+#define __POLL_RATE__
+
+#include <stdint.h>
+
+// Rate the host is asked to poll the gamepad endpoint at.  Some hosts
+// cannot keep up with 1 kHz, so a slower rate can be picked at power-on
+// by holding a button, and is remembered in the config store.
+
+// Polling rates, numbered so the interval in frames is 1 << rate.  Held
+// button N at power-on selects rate N - 1.
+enum PollRate
+{
+  POLL_RATE_1000HZ = 0,
+  POLL_RATE_500HZ,
+  POLL_RATE_250HZ,
+  POLL_RATE_125HZ,
+  POLL_RATE_COUNT
+};
+
+// Polling interval of a rate, in 1 ms frames (the endpoints' bInterval).
+#define POLL_RATE_INTERVAL(rate) (1 << (rate))
+
+// Picks the polling rate from the buttons held at power-on.  Holding
+// button 1, 2, 3 or 4 selects 1000, 500, 250 or 125 Hz and saves it;
+// with none held the stored rate is used.
+uint8_t select_poll_rate(const uint8_t buttons[2]);
+
+#endif //#ifndef __POLL_RATE__
@@ -0,0 +1,96 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __SEQ_BUFFER_H__
+#define __SEQ_BUFFER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// Keeps the compiler from moving memory accesses across it, so the slot
+// is filled before it is published and copied between two reads of the
+// sequence number.
+#define SEQ_BUFFER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+// Lock-free hand-off of a small block of state between the main loop and
+// an interrupt handler, with one writer.  The writer fills the slot that
+// is not current and then bumps the sequence number, whose low bit
+// selects the current slot, so a reader never sees a half-written copy
+// and nobody disables interrupts.
+//
+// A reader the writer cannot interrupt (an ISR reading what the main
+// loop wrote) can use the current slot in place.  A reader the writer
+// can interrupt copies it out with seq_buffer_read(), which retries if
+// the writer published during the copy.
+
+struct SeqBuffer
+{
+  volatile uint8_t sequence;
+  uint8_t size;
+  uint8_t* slots;
+};
+
+// Static initializer for a buffer over "type slots[2]".
+#define SEQ_BUFFER_INIT(slots) {0, sizeof((slots)[0]), (uint8_t*)(slots)}
+
+// Slot for the writer to fill before calling seq_buffer_publish().
+static inline void* seq_buffer_next(const struct SeqBuffer* buffer)
+{
+  return buffer->slots + (~buffer->sequence & 1) * buffer->size;
+}
+
+// Makes the slot returned by seq_buffer_next() current.
+static inline void seq_buffer_publish(struct SeqBuffer* buffer)
+{
+  SEQ_BUFFER_BARRIER();
+  buffer->sequence++;
+}
+
+// Current slot, only stable while the writer cannot run.
+static inline const void* seq_buffer_current(const struct SeqBuffer* buffer)
+{
+  return buffer->slots + (buffer->sequence & 1) * buffer->size;
+}
+
+// Copies the current slot out consistently and returns the sequence
+// number it was published under.
+static inline uint8_t seq_buffer_read(const struct SeqBuffer* buffer, void* copy)
+{
+  uint8_t sequence;
+
+  do
+  {
+    sequence = buffer->sequence;
+    SEQ_BUFFER_BARRIER();
+    memcpy(copy, buffer->slots + (sequence & 1) * buffer->size, buffer->size);
+    SEQ_BUFFER_BARRIER();
+  } while (sequence != buffer->sequence);
+
+  return sequence;
+}
+
+#endif
@@ -26,9 +26,57 @@
 
 #include <avr/io.h>
 #include <avr/pgmspace.h>
+#include <avr/interrupt.h>
 #include "serial_controller.h"
+#include "seq_buffer.h"
+#include "timer.h"
 #include "pins.h"
 
+// A scan of the chain and the time its inputs were latched.
+struct ChainScan
+{
+  uint16_t latchTime;
+  uint8_t pins[NUM_CONTROLLER_STATE_BYTES];
+};
+
+// Complete scans of the chain.  The SPI interrupt is the writer, filling
+// the next slot one byte per interrupt and publishing it after the last.
+static struct ChainScan chainScans[2];
+static struct SeqBuffer chainScanBuffer = SEQ_BUFFER_INIT(chainScans);
+
+// Scan in progress: latch time, index of the byte being shifted in, and
+// whether the interrupt is still running it.
+static volatile uint16_t scanLatchTime = 0;
+static volatile uint8_t scanIndex = 0;
+static volatile uint8_t scanBusy = 0;
+
+// Loads the inputs into the shift registers and releases the clock
+// inhibit, so the first register's byte is ready to shift out.
+static void latch_chain(void)
+{
+  // Set SH/LD low.
+  PORTD &= ~(1<<PD1);
+
+  // Simulate a clock tick to initiate Parallel load.
+  PORTB &= ~(1<<PB0);
+  PORTB |= (1<<PB0);
+
+  // Set SH/LD high.
+  PORTD |= (1<<PD1);
+
+  // Drop CLK INH.
+  PORTB &= ~(1<<PB0);
+}
+
+// Shifts one byte in from MISO, waiting for it.  Only used while the SPI
+// interrupt is disabled.
+static uint8_t transfer_byte(void)
+{
+  SPDR = 0x00;
+  while (!(SPSR & (1<<SPIF)));
+  return SPDR;
+}
+
 void init_controller_serial(void)
 {
   // Set SS, SCLK, and PD1 as output.
@@ -47,25 +95,75 @@ void init_controller_serial(void)
   PORTD |= (1<<PD1);
 }
 
-void get_controller_state_serial(uint8_t pins[NUM_CONTROLLER_STATE_BYTES])
+// Takes a scan with the SPI interrupt disabled, waiting for every byte,
+// so there is a complete one to return.
+static void scan_chain_blocking(void)
 {
-  // Set SH/LD low.
-  PORTD &= ~(1<<PD1);
-
-  // Simulate a clock tick to initiate Parallel load.
-  PORTB &= ~(1<<PB0);
+  struct ChainScan* scan = seq_buffer_next(&chainScanBuffer);
+  scan->latchTime = timer_now();
+  latch_chain();
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    scan->pins[i] = transfer_byte();
+  }
   PORTB |= (1<<PB0);
+  seq_buffer_publish(&chainScanBuffer);
+}
 
-  // Set SH/LD high.
-  PORTD |= (1<<PD1);
+// Starts shifting the chain out, one byte per SPI interrupt.
+static void start_scan(void)
+{
+  scanLatchTime = timer_now();
+  latch_chain();
+  scanIndex = 0;
+  scanBusy = 1;
+  SPDR = 0x00;
+}
 
-  // Drop CLK INH, Load 8 bits from MISO, set CLK INH high again.
-  PORTB &= ~(1<<PB0);
-  for (unsigned i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
-    {
-      SPDR = 0x00;
-      while (!(SPSR & (1<<SPIF)));
-      pins[i] = SPDR;
-    }
+void get_controller_state_serial(uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp)
+{
+  struct ChainScan scan;
+
+  // The first call scans the chain on the spot, so it sees the inputs as
+  // they are after the caller's settle time rather than at
+  // initialization.  From then on the chain is shifted by the SPI
+  // interrupt.
+  if (!(SPCR & (1<<SPIE)))
+  {
+    scan_chain_blocking();
+    SPCR |= (1<<SPIE);
+  }
+
+  seq_buffer_read(&chainScanBuffer, &scan);
+  for (uint8_t i = 0; i < NUM_CONTROLLER_STATE_BYTES; ++i)
+  {
+    pins[i] = scan.pins[i];
+  }
+  *timestamp = scan.latchTime;
+
+  // Shift the next scan in while the caller works on this one.
+  if (!scanBusy)
+  {
+    start_scan();
+  }
+}
+
+ISR(SPI_STC_vect)
+{
+  struct ChainScan* scan = seq_buffer_next(&chainScanBuffer);
+  uint8_t index = scanIndex;
+
+  scan->pins[index++] = SPDR;
+  if (index < NUM_CONTROLLER_STATE_BYTES)
+  {
+    scanIndex = index;
+    SPDR = 0x00;
+    return;
+  }
+
+  // Set CLK INH high again and hand the scan over.
   PORTB |= (1<<PB0);
+  scan->latchTime = scanLatchTime;
+  seq_buffer_publish(&chainScanBuffer);
+  scanBusy = 0;
 }
@@ -30,12 +30,24 @@
 #include "pins.h"
 #include <stdint.h>
 
-// Reads controller state input from a single pin using the SPI protocol.
+// Reads controller state from a chain of 74HC165 shift registers over
+// SPI.  The chain is shifted by the SPI interrupt, one byte per
+// interrupt, so a scan runs while the main loop works on the previous
+// one.
+//
+// The chain is NUM_CONTROLLER_STATE_BYTES registers long, as set by
+// STATE_BYTES in the Makefile, which is what the filter, the remap and
+// the reports carry.  Nothing has to be wired to the serial input of the
+// last register.
 
 // Must be called once to initialize the controller interface.
 void init_controller_serial(void);
 
-// Returns the state of joystick and buttons.
-void get_controller_state_serial(uint8_t pins[NUM_CONTROLLER_STATE_BYTES]);
+// Returns the state of joystick and buttons from the latest complete
+// scan, first register first, with the timer.h timestamp of its latch,
+// and starts the next scan.  The scan was latched on an earlier call, so
+// the timestamp is older than the call.  The first call waits for a scan
+// latched on the spot.
+void get_controller_state_serial(uint8_t pins[NUM_CONTROLLER_STATE_BYTES], uint16_t* timestamp);
 
 #endif
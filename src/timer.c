@@ -0,0 +1,82 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "loop_monitor.h"
+#include "timer.h"
+
+// Upper half of timer_now_long(), counted by the overflow interrupt.
+static volatile uint16_t timerOverflows = 0;
+
+void init_timer(void)
+{
+  // Normal mode, clk/64, interrupt on overflow.
+  TCCR1A = 0;
+  TCCR1B = (1<<CS11) | (1<<CS10);
+  TIFR1 = (1<<TOV1);
+  TIMSK1 |= (1<<TOIE1);
+}
+
+uint16_t timer_now(void)
+{
+  uint16_t now;
+
+  // The 16-bit read goes through the shared TEMP register, so it must not
+  // be interleaved with a read of TCNT1 from an interrupt handler.
+  LOOP_ATOMIC_BLOCK(LOOP_ATOMIC_TIMER)
+  {
+    now = TCNT1;
+  }
+  return now;
+}
+
+uint32_t timer_now_long(void)
+{
+  uint16_t now;
+  uint16_t overflows;
+
+  LOOP_ATOMIC_BLOCK(LOOP_ATOMIC_TIMER)
+  {
+    now = TCNT1;
+    overflows = timerOverflows;
+
+    // An overflow that is still pending (interrupts are disabled, or it
+    // happened just now) has not been counted yet.  The low half tells
+    // whether it came before or after the read.
+    if ((TIFR1 & (1<<TOV1)) && now < 0x8000)
+    {
+      ++overflows;
+    }
+  }
+  return ((uint32_t)overflows << 16) | now;
+}
+
+ISR(TIMER1_OVF_vect)
+{
+  ++timerOverflows;
+}
@@ -0,0 +1,56 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <stdint.h>
+
+// Free-running 16-bit timestamp counter on Timer1.  Timer1 is clocked at
+// F_CPU/64, so one tick is 4 us at 16 MHz and the counter wraps every
+// 262 ms.  Differences between two timestamps are valid as long as they
+// are taken less than one wrap period apart.
+
+#define TIMER_PRESCALER (64)
+#define TIMER_TICKS_PER_MS ((uint16_t)(F_CPU / TIMER_PRESCALER / 1000UL))
+#define TIMER_US_PER_TICK (1000000UL / (F_CPU / TIMER_PRESCALER))
+
+// Converts a duration in microseconds to timer ticks.
+#define TIMER_US_TO_TICKS(us) ((uint16_t)((us) / TIMER_US_PER_TICK))
+
+// Must be called once to start the timer.
+void init_timer(void);
+
+// Returns the current timestamp in timer ticks.
+uint16_t timer_now(void);
+
+// Returns the current timestamp extended to 32 bits with a count of
+// counter wraps kept by the overflow interrupt, for durations longer
+// than one wrap period.  Can be called with interrupts disabled.
+uint32_t timer_now_long(void);
+
+#endif
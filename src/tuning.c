@@ -0,0 +1,204 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "loop_monitor.h"
+#include "tuning.h"
+#include "config_store.h"
+#include "poll_rate.h"
+#include "usb_gamepad.h"
+
+// Command queued by the USB interrupt.  The main loop owns it from when
+// commandPending is set until it clears it again.
+static uint8_t command[TUNING_COMMAND_SIZE];
+static volatile uint8_t commandPending;
+
+// Outcome of the last command applied.
+static uint8_t lastSequence;
+static uint8_t lastResult;
+static uint8_t unsaved;
+
+uint8_t tuning_receive(const uint8_t* data, uint8_t length)
+{
+  if (commandPending || length < 3 || length > TUNING_COMMAND_SIZE)
+  {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < TUNING_COMMAND_SIZE; ++i)
+  {
+    command[i] = (i < length) ? data[i] : 0;
+  }
+  commandPending = 1;
+  return 1;
+}
+
+static void apply_window(struct InputFilter* inputFilter, uint8_t input)
+{
+  set_input_filter_window(inputFilter, input / BITS_PER_BYTE, 1 << (input % BITS_PER_BYTE),
+    get_config()->debounceUs[input]);
+}
+
+// Reconfigures the filter and the remap stage from the whole cache.
+static void apply_config(struct InputFilter* inputFilter, struct InputRemap* inputRemap)
+{
+  const struct Config* config = get_config();
+  for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+  {
+    apply_window(inputFilter, i);
+  }
+  set_input_filter_mode(inputFilter, config->pressMode, config->releaseMode);
+  set_input_filter_adaptive(inputFilter, config->adaptiveDebounce);
+  set_input_remap(inputRemap, config->remap);
+  usb_set_report_interval(POLL_RATE_INTERVAL(config->pollRate));
+}
+
+static uint8_t run_command(struct InputFilter* inputFilter, struct InputRemap* inputRemap)
+{
+  struct Config* config = get_config();
+  uint8_t input = command[3];
+  uint8_t inputValid = input < REMAP_NUM_INPUTS || input == TUNING_ALL_INPUTS;
+
+  switch (command[2])
+  {
+  case TUNING_SET_WINDOW:
+  {
+    uint16_t windowUs = command[4] | (command[5] << 8);
+    if (!inputValid || windowUs > MAX_DEBOUNCE_US)
+    {
+      return TUNING_BAD_ARGUMENT;
+    }
+    for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+    {
+      if (input == i || input == TUNING_ALL_INPUTS)
+      {
+        LOOP_ATOMIC_BLOCK(LOOP_ATOMIC_TUNING)
+        {
+          config->debounceUs[i] = windowUs;
+        }
+        apply_window(inputFilter, i);
+      }
+    }
+    break;
+  }
+
+  case TUNING_SET_FILTER_MODE:
+    if (command[3] > FILTER_EAGER || command[4] > FILTER_EAGER || command[5] > 1)
+    {
+      return TUNING_BAD_ARGUMENT;
+    }
+    config->pressMode = command[3];
+    config->releaseMode = command[4];
+    config->adaptiveDebounce = command[5];
+    set_input_filter_mode(inputFilter, config->pressMode, config->releaseMode);
+    set_input_filter_adaptive(inputFilter, config->adaptiveDebounce);
+    break;
+
+  case TUNING_SET_REMAP:
+    if (!inputValid || (command[4] > REMAP_DOWN && command[4] != REMAP_NONE))
+    {
+      return TUNING_BAD_ARGUMENT;
+    }
+    for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+    {
+      if (input == i || input == TUNING_ALL_INPUTS)
+      {
+        config->remap[i] = command[4];
+      }
+    }
+    set_input_remap(inputRemap, config->remap);
+    break;
+
+  case TUNING_SET_POLL_RATE:
+    if (command[3] >= POLL_RATE_COUNT)
+    {
+      return TUNING_BAD_ARGUMENT;
+    }
+    config->pollRate = command[3];
+    usb_set_report_interval(POLL_RATE_INTERVAL(config->pollRate));
+    break;
+
+  case TUNING_SAVE:
+    save_config();
+    unsaved = 0;
+    return TUNING_OK;
+
+  case TUNING_LOAD_DEFAULTS:
+    LOOP_ATOMIC_BLOCK(LOOP_ATOMIC_TUNING)
+    {
+      reset_config();
+    }
+    apply_config(inputFilter, inputRemap);
+    break;
+
+  default:
+    return TUNING_BAD_COMMAND;
+  }
+
+  unsaved = 1;
+  return TUNING_OK;
+}
+
+void tuning_poll(struct InputFilter* inputFilter, struct InputRemap* inputRemap)
+{
+  if (!commandPending)
+  {
+    return;
+  }
+
+  lastResult = run_command(inputFilter, inputRemap);
+  lastSequence = command[1];
+  commandPending = 0;
+}
+
+uint8_t write_tuning_report(uint8_t reportId, uint8_t report[TUNING_REPORT_SIZE])
+{
+  const struct Config* config = get_config();
+
+  report[0] = reportId;
+  report[1] = CONFIG_VERSION;
+  report[2] = lastSequence;
+  report[3] = lastResult;
+  report[4] = (commandPending ? TUNING_FLAG_PENDING : 0) |
+              (config_store_busy() ? TUNING_FLAG_SAVING : 0) |
+              (unsaved ? TUNING_FLAG_UNSAVED : 0);
+  report[5] = config->controllerType;
+  report[6] = config->profile;
+  report[7] = config->pollRate;
+  report[8] = config->pressMode;
+  report[9] = config->releaseMode;
+  report[10] = config->adaptiveDebounce;
+
+  uint8_t* field = report + 11;
+  for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+  {
+    *field++ = config->debounceUs[i] & 0xFF;
+    *field++ = config->debounceUs[i] >> 8;
+  }
+  for (uint8_t i = 0; i < REMAP_NUM_INPUTS; ++i)
+  {
+    *field++ = config->remap[i];
+  }
+  return TUNING_REPORT_SIZE;
+}
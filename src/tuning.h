@@ -0,0 +1,102 @@
+/*
+  Pew Pew Stick Microcontroller Code
+  Copyright (c) 2012, Matt Stine, Brandon Booth
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met: 
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer. 
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution. 
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __TUNING__
+#define __TUNING__
+
+#include "input_filter.h"
+#include "input_remap.h"
+#include <stdint.h>
+
+// Live tuning over vendor feature reports (see usb_gamepad.h).  The host
+// sends a command with SET_REPORT and reads the settings in use, with
+// the outcome of its last command, with GET_REPORT.  The USB interrupt
+// only queues a command; the main loop applies it between two samples,
+// so the filter and the remap tables never run with half a change.
+//
+// Changes are live at once.  A new polling rate sets how often reports
+// are sent, but not faster than the rate the host enumerated the device
+// with; the endpoints are polled at the new rate from the next power-on.
+// All changes are lost at reset unless saved to the config store.
+
+enum TuningCommand
+{
+  TUNING_SET_WINDOW = 1,
+  TUNING_SET_FILTER_MODE,
+  TUNING_SET_REMAP,
+  TUNING_SET_POLL_RATE,
+  TUNING_SAVE,
+  TUNING_LOAD_DEFAULTS
+};
+
+enum TuningResult
+{
+  TUNING_OK,
+  TUNING_BAD_COMMAND,
+  TUNING_BAD_ARGUMENT
+};
+
+// Command report: report ID, sequence number chosen by the host, command
+// and its arguments, zero-padded:
+//
+//   TUNING_SET_WINDOW       input, window in microseconds (16 bits, at
+//                           most MAX_DEBOUNCE_US)
+//   TUNING_SET_FILTER_MODE  press mode, release mode (enum
+//                           InputFilterMode), adaptive windows (0 or 1)
+//   TUNING_SET_REMAP        input, output (enum RemapOutput)
+//   TUNING_SET_POLL_RATE    rate (enum PollRate)
+//   TUNING_SAVE             writes the settings to the config store
+//   TUNING_LOAD_DEFAULTS    puts the defaults in use, without saving
+//
+// Inputs are numbered state byte * 8 + bit number, or TUNING_ALL_INPUTS.
+#define TUNING_COMMAND_SIZE 8
+#define TUNING_ALL_INPUTS 0xFF
+
+// Settings report: report ID, CONFIG_VERSION, sequence number and result
+// (enum TuningResult) of the last command applied, TUNING_FLAG_ bits,
+// then controller type, profile, polling rate, press mode, release mode
+// and adaptive windows, one byte each, the window of each input in
+// microseconds (16 bits each) and the output of each input,
+// little-endian.
+#define TUNING_REPORT_SIZE (11 + 3 * REMAP_NUM_INPUTS)
+
+// Settings report flags.
+#define TUNING_FLAG_PENDING (1<<0)  // a command is waiting for the main loop
+#define TUNING_FLAG_SAVING  (1<<1)  // a save is being written
+#define TUNING_FLAG_UNSAVED (1<<2)  // settings changed since the last save
+
+// USB interrupt: queues the 'length' bytes of a command report.  Returns
+// 0 if a command is still waiting or the report is malformed.
+uint8_t tuning_receive(const uint8_t* command, uint8_t length);
+
+// Main loop: applies the queued command, if there is one, to the config
+// store's cache and to the filter and remap stage configured from it.
+void tuning_poll(struct InputFilter* inputFilter, struct InputRemap* inputRemap);
+
+// Writes the settings report with ID 'reportId' into 'report' and returns
+// its size.  Can be called from an interrupt handler.
+uint8_t write_tuning_report(uint8_t reportId, uint8_t report[TUNING_REPORT_SIZE]);
+
+#endif //#ifndef __TUNING__
@@ -25,8 +25,25 @@
 
 #include "usb_profiles.h"
 #include "usb_gamepad.h"
+#include "timer.h"
+#include "seq_buffer.h"
+#include "latency_stats.h"
+#include "loop_monitor.h"
+#include "input_filter.h"
+#include "tuning.h"
 #include "string.h"
 
+// Length of a full speed USB frame.
+#define FRAME_TICKS		TIMER_US_TO_TICKS(1000)
+
+// How long before the host's IN token the report is committed.  This
+// covers the interrupt latency plus one pass of the main loop.
+#define REPORT_COMMIT_MARGIN_TICKS	TIMER_US_TO_TICKS(150)
+
+// Earliest commit point after start-of-frame, so the compare match is
+// never armed in the past.
+#define REPORT_COMMIT_MIN_TICKS	TIMER_US_TO_TICKS(50)
+
 /**************************************************************************
  *
  *  Variables - these are the only non-stack RAM usage
@@ -36,12 +53,90 @@
 // zero when we are not configured, non-zero when enumerated
 static volatile uint8_t usb_configuration = 0;
 
-uint8_t joystick_x = 128;
-uint8_t joystick_y = 128;
+// Profile the device enumerates as, given to usb_init(), and the report
+// writer for it, selected when the host configures the device.
+static Profile usb_profile;
+static ReportWriter gamepad_report_writer;
+
+// Latest gamepad state, published by the main loop.  The interrupt
+// handlers cannot be interrupted by the main loop, so they read the
+// current slot in place.
+static struct gamepad_state gamepad_states[2] = {
+	{128, 128, {0, 0}},
+	{128, 128, {0, 0}}
+};
+static struct SeqBuffer gamepad_state_buffer = SEQ_BUFFER_INIT(gamepad_states);
 
-uint8_t gamepad_buttons[2] = {0};
+// State of the last report loaded into the endpoint, only used by the
+// interrupt handlers.  A report is only sent when the state differs from
+// this, when the idle period expires, or when gamepad_report_stale is set.
+static struct gamepad_state gamepad_report_sent;
+static uint8_t gamepad_report_stale = 1;
 
+// idle period requested by SET_IDLE, in 4 ms units (0 = only send on
+// change), and the frame the last report was sent in
 static uint8_t gamepad_idle_config = 0;
+static uint16_t gamepad_report_frame = 0;
+
+// Timestamp of the last start-of-frame, and frames counted since reset.
+static volatile uint16_t usb_sof_time = 0;
+static uint16_t usb_frame_count = 0;
+
+// Polling interval of the gamepad endpoint in frames, a power of two.
+// The host reads it in frames where (frame & (interval - 1)) has the same
+// value, so once a read has been seen the report is only committed in
+// frames where (usb_frame_count & usb_commit_mask) == usb_commit_frame.
+// Until then the mask is zero and a report is committed every frame.
+// Reports may be committed every usb_report_interval frames instead, a
+// multiple of the polling interval, and the host's reads in between are
+// NAKed.
+static uint8_t usb_poll_interval = 1;
+static volatile uint8_t usb_report_interval = 1;
+static uint8_t usb_commit_mask = 0;
+static uint8_t usb_commit_frame = 0;
+
+// Boot timing, in timer_now_long() ticks, 0 until it happened.
+static uint32_t boot_init_time;
+static uint32_t boot_configured_time;
+static uint32_t boot_report_time;
+
+// Vendor feature report being sent by the control endpoint.
+#if TUNING_REPORT_SIZE > INPUT_FILTER_REPORT_SIZE && TUNING_REPORT_SIZE > LATENCY_REPORT_SIZE
+#define VENDOR_REPORT_MAX_SIZE	TUNING_REPORT_SIZE
+#elif INPUT_FILTER_REPORT_SIZE > LATENCY_REPORT_SIZE
+#define VENDOR_REPORT_MAX_SIZE	INPUT_FILTER_REPORT_SIZE
+#else
+#define VENDOR_REPORT_MAX_SIZE	LATENCY_REPORT_SIZE
+#endif
+static uint8_t vendor_report[VENDOR_REPORT_MAX_SIZE];
+
+// Configuration descriptor, copied to RAM by usb_init() with the gamepad
+// endpoint's bInterval set to the polling interval.
+#define CONFIG_DESC_MAX_SIZE	64
+static uint8_t usb_config_descriptor[CONFIG_DESC_MAX_SIZE];
+static uint8_t usb_config_descriptor_len;
+
+// Time after start-of-frame at which the next report is due.  Starts out
+// late in the frame and then tracks the host's IN token as soon as the
+// first report has been read.
+static volatile uint16_t usb_report_offset = TIMER_US_TO_TICKS(850);
+
+// Control transfer in progress on endpoint 0.  Data and status stages
+// are driven one packet at a time from USB_COM_vect, so the handler
+// never waits for the host.
+#define EP0_IDLE		0
+#define EP0_DATA_IN		1	// sending ep0_data
+#define EP0_STATUS_OUT		2	// waiting for the host's OUT handshake
+#define EP0_SET_ADDRESS		3	// address takes effect once the IN handshake is read
+#define EP0_DATA_OUT		4	// waiting for a SET_REPORT data packet
+static uint8_t ep0_state = EP0_IDLE;
+static const uint8_t *ep0_data;
+static uint8_t ep0_data_in_ram;		// ep0_data is in RAM, not flash
+static uint8_t ep0_remaining;
+static uint8_t ep0_address;
+static uint16_t ep0_report;		// wValue of the SET_REPORT in progress
+static uint16_t ep0_out_length;		// and its wLength
+static uint8_t ep0_size = ENDPOINT0_SIZE;	// packet size of the profile
 
 // protocol setting from the host.  We use exactly the same report
 // either way, so this variable only stores the setting since we
@@ -55,8 +150,27 @@ static uint8_t gamepad_protocol = 1;
  **************************************************************************/
 
 
+// Copy the profile's configuration descriptor to RAM and set the
+// bInterval of its IN endpoints.
+static void usb_load_config_descriptor(uint8_t interval)
+{
+	const uint8_t *addr;
+	uint8_t len, i;
+
+	usb_config_descriptor_len = 0;
+	if (get_descriptor(usb_profile, 0x0200, 0, &addr, &len)) return;
+	if (len > sizeof(usb_config_descriptor)) len = sizeof(usb_config_descriptor);
+	memcpy_P(usb_config_descriptor, addr, len);
+	usb_config_descriptor_len = len;
+	for (i = 0; i + 6 < len && usb_config_descriptor[i]; i += usb_config_descriptor[i]) {
+		if (usb_config_descriptor[i + 1] == 5 && (usb_config_descriptor[i + 2] & 0x80)) {
+			usb_config_descriptor[i + 6] = interval;
+		}
+	}
+}
+
 // initialize USB
-void usb_init(void) {
+void usb_init(Profile profile, uint8_t interval) {
 	HW_CONFIG();
 	USB_FREEZE();	// enable USB
 	PLL_CONFIG();				// config PLL
@@ -64,6 +178,13 @@ void usb_init(void) {
         USB_CONFIG();				// start USB clock
         UDCON = 0;				// enable attach resistor
 	usb_configuration = 0;
+	usb_profile = profile;
+	ep0_size = get_endpoint0_size(profile);
+	usb_poll_interval = interval;
+	usb_report_interval = interval;
+	usb_load_config_descriptor(interval);
+	boot_init_time = timer_now_long();
+	gamepad_report_writer = get_report_writer(usb_profile);
         UDIEN = (1<<EORSTE)|(1<<SOFE);
 	sei();
 }
@@ -74,42 +195,22 @@ uint8_t usb_configured(void) {
   return usb_configuration;
 }
 
-int8_t usb_gamepad_action(uint8_t x, uint8_t y, uint8_t buttons[2]) {
-  joystick_x = x;
-  joystick_y = y;
-  memcpy(gamepad_buttons, buttons, 2); 
-
-  return usb_gamepad_send();
+// commit reports every interval frames from the next one the host reads,
+// but not more often than it polls
+void usb_set_report_interval(uint8_t interval) {
+	if (interval < usb_poll_interval) interval = usb_poll_interval;
+	usb_report_interval = interval;
 }
 
-int8_t usb_gamepad_send(void) {
-	uint8_t intr_state, timeout;
+// publish the latest gamepad state, it is sent at the next commit point
+int8_t usb_gamepad_action(uint8_t x, uint8_t y, uint8_t buttons[2]) {
+	struct gamepad_state *state = seq_buffer_next(&gamepad_state_buffer);
 
-	if (!usb_configuration) return -1;
-	intr_state = SREG;
-	cli();
-	UENUM = GAMEPAD_ENDPOINT_IN;
-	timeout = UDFNUML + 50;
-	while (1) {
-		// are we ready to transmit?
-		if (UEINTX & (1<<RWAL)) break;
-		SREG = intr_state;
-		// has the USB gone offline?
-		if (!usb_configuration) return -1;
-		// have we waited too long?
-		if (UDFNUML == timeout) return -1;
-		// get ready to try checking again
-		intr_state = SREG;
-		cli();
-		UENUM = GAMEPAD_ENDPOINT_IN;
-	}
-	UEDATX = joystick_x;
-	UEDATX = joystick_y;
-	UEDATX = gamepad_buttons[0];
-	UEDATX = gamepad_buttons[1];
-	UEINTX = 0x3A;
-	SREG = intr_state;
-	return 0;
+	state->x = x;
+	state->y = y;
+	memcpy(state->buttons, buttons, 2);
+	seq_buffer_publish(&gamepad_state_buffer);
+	return usb_configuration ? 0 : -1;
 }
 
 /**************************************************************************
@@ -121,6 +222,7 @@ int8_t usb_gamepad_send(void) {
 ISR(USB_GEN_vect)
 {
 	uint8_t intbits;
+	uint16_t start = TCNT1;
 
         intbits = UDINT;
         UDINT = 0;
@@ -128,10 +230,101 @@ ISR(USB_GEN_vect)
 		UENUM = 0;
 		UECONX = 1;
 		UECFG0X = EP_TYPE_CONTROL;
-		UECFG1X = EP_SIZE(ENDPOINT0_SIZE) | EP_SINGLE_BUFFER;
+		UECFG1X = EP_SIZE(ep0_size) | EP_SINGLE_BUFFER;
 		UEIENX = (1<<RXSTPE);
 		usb_configuration = 0;
         }
+	if (intbits & (1<<SOFI)) {
+		// arm the commit timer if the report is due in this frame
+		usb_sof_time = TCNT1;
+		usb_frame_count++;
+		if (((uint8_t)usb_frame_count & usb_commit_mask) == usb_commit_frame) {
+			OCR1A = usb_sof_time + usb_report_offset;
+			TIFR1 = (1<<OCF1A);
+			TIMSK1 |= (1<<OCIE1A);
+		}
+	}
+	loop_monitor_irq(LOOP_IRQ_USB_GEN, start);
+}
+
+// load the latest report into the gamepad endpoint if it changed or
+// the idle period expired, and the bank is free.  Called once per polling
+// interval with interrupts disabled.
+static void usb_gamepad_send(void)
+{
+	const struct gamepad_state *state;
+	uint8_t changed;
+
+	if (!usb_configuration) return;
+	state = seq_buffer_current(&gamepad_state_buffer);
+	changed = memcmp(state, &gamepad_report_sent, sizeof(gamepad_report_sent)) != 0;
+	if (!gamepad_report_stale && !changed
+	  && (gamepad_idle_config == 0
+	    || (uint16_t)(usb_frame_count - gamepad_report_frame) < (uint16_t)gamepad_idle_config * 4)) {
+		latency_mark_handoff(0, 0);
+		return;
+	}
+	UENUM = GAMEPAD_ENDPOINT_IN;
+	// the host has not read the previous report yet
+	if (!(UEINTX & (1<<RWAL))) return;
+	gamepad_report_writer(state);
+	UEINTX = 0x3A;
+	latency_mark_handoff(changed, TCNT1);
+	gamepad_report_sent = *state;
+	gamepad_report_stale = 0;
+	if (!boot_report_time) boot_report_time = timer_now_long();
+	gamepad_report_frame = usb_frame_count;
+	// interrupt when the host has read the report, to learn
+	// where in the frame its IN token arrives
+	UEIENX = (1<<TXINE);
+}
+
+// Store a timer_now_long() time in microseconds, little-endian.
+static void put_boot_time(uint8_t *p, uint32_t ticks)
+{
+	uint32_t us = ticks * TIMER_US_PER_TICK;
+
+	p[0] = us;
+	p[1] = us >> 8;
+	p[2] = us >> 16;
+	p[3] = us >> 24;
+}
+
+// Build vendor feature report id in vendor_report, returning its length,
+// or 0 if there is no such report.
+static uint8_t usb_vendor_report(uint8_t id)
+{
+	if (id >= LATENCY_REPORT_ID(0) && id < LATENCY_REPORT_ID(LATENCY_STAGE_COUNT)) {
+		return write_latency_report(id - LATENCY_REPORT_ID(0), id, vendor_report);
+	}
+	if (id >= FILTER_REPORT_ID(0) && id < FILTER_REPORT_ID(NUM_CONTROLLER_STATE_BYTES)) {
+		return write_input_filter_report(id - FILTER_REPORT_ID(0), id, vendor_report);
+	}
+	switch (id) {
+	case LOOP_REPORT_ID:
+		return write_loop_report(id, vendor_report);
+	case TUNING_REPORT_ID:
+		return write_tuning_report(id, vendor_report);
+	case BOOT_TIMING_REPORT_ID:
+		vendor_report[0] = id;
+		put_boot_time(vendor_report + 1, boot_init_time);
+		put_boot_time(vendor_report + 5, boot_configured_time);
+		put_boot_time(vendor_report + 9, boot_report_time);
+		return BOOT_TIMING_REPORT_SIZE;
+	default:
+		return 0;
+	}
+}
+
+// Report commit timer, fires once per polling interval just before
+// the host is expected to read the gamepad endpoint.
+ISR(TIMER1_COMPA_vect)
+{
+	uint16_t start = TCNT1;
+
+	TIMSK1 &= ~(1<<OCIE1A);
+	usb_gamepad_send();
+	loop_monitor_irq(LOOP_IRQ_REPORT_TIMER, start);
 }
 
 // Misc functions to wait for ready and send/receive packets
@@ -143,24 +336,131 @@ static inline void usb_send_in(void)
 {
 	UEINTX = ~(1<<TXINI);
 }
-static inline void usb_wait_receive_out(void)
-{
-	while (!(UEINTX & (1<<RXOUTI))) ;
-}
 static inline void usb_ack_out(void)
 {
 	UEINTX = ~(1<<RXOUTI);
 }
 
+// Copy a packet from flash into the selected endpoint, four bytes per
+// loop pass.
+static inline void usb_write_P(const uint8_t *src, uint8_t n)
+{
+	uint8_t i;
+
+	for (i = n >> 2; i; i--) {
+		UEDATX = pgm_read_byte(src++);
+		UEDATX = pgm_read_byte(src++);
+		UEDATX = pgm_read_byte(src++);
+		UEDATX = pgm_read_byte(src++);
+	}
+	for (i = n & 3; i; i--) {
+		UEDATX = pgm_read_byte(src++);
+	}
+}
+
+// Same from RAM.
+static inline void usb_write(const uint8_t *src, uint8_t n)
+{
+	uint8_t i;
+
+	for (i = n; i; i--) {
+		UEDATX = *src++;
+	}
+}
+
+// Take a data packet of a SET_REPORT, with endpoint 0 selected, and
+// count it off ep0_out_length.  Only the tuning command report is used;
+// it must come as a single packet of wLength bytes.  The data of any
+// other report is discarded packet by packet until wLength bytes or a
+// short packet have arrived.  Returns 0 if the request is to be stalled.
+static uint8_t usb_set_report_data(void)
+{
+	uint8_t buf[TUNING_COMMAND_SIZE];
+	uint8_t i, n;
+
+	n = UEBCLX;
+	if (ep0_report == ((3 << 8) | TUNING_COMMAND_REPORT_ID)) {
+		if (n != ep0_out_length || n > sizeof(buf)) return 0;
+		ep0_out_length = 0;
+		for (i = 0; i < n; i++) {
+			buf[i] = UEDATX;
+		}
+		return tuning_receive(buf, n);
+	}
+	if (n > ep0_out_length) return 0;
+	ep0_out_length -= n;
+	if (n < ep0_size) ep0_out_length = 0;
+	return 1;
+}
+
+// Move the control transfer in progress on to its next packet.  Called
+// with endpoint 0 selected, when it has interrupted with TXINI or RXOUTI.
+static void usb_ep0_continue(uint8_t intbits)
+{
+	uint8_t n;
+
+	if (intbits & (1<<RXOUTI)) {
+		// SET_REPORT data, or the host ending an IN transfer early or
+		// sending its status handshake
+		if (ep0_state == EP0_DATA_OUT) {
+			n = usb_set_report_data();
+			usb_ack_out();
+			// wait for the rest of the data stage
+			if (n && ep0_out_length) return;
+			if (n) usb_send_in();
+			else UECONX = (1<<STALLRQ) | (1<<EPEN);
+		} else {
+			usb_ack_out();
+		}
+		ep0_state = EP0_IDLE;
+		UEIENX = (1<<RXSTPE);
+		return;
+	}
+	if (!(intbits & (1<<TXINI))) return;
+	if (ep0_state == EP0_SET_ADDRESS) {
+		UDADDR = ep0_address | (1<<ADDEN);
+		ep0_state = EP0_IDLE;
+		UEIENX = (1<<RXSTPE);
+		return;
+	}
+	if (ep0_state == EP0_DATA_IN) {
+		n = ep0_remaining < ep0_size ? ep0_remaining : ep0_size;
+		if (ep0_data_in_ram) usb_write(ep0_data, n);
+		else usb_write_P(ep0_data, n);
+		ep0_data += n;
+		ep0_remaining -= n;
+		usb_send_in();
+		// a short packet ends the data stage
+		if (n < ep0_size) {
+			ep0_state = EP0_STATUS_OUT;
+			UEIENX = (1<<RXSTPE)|(1<<RXOUTE);
+		}
+	}
+}
+
+// Start sending len bytes from flash (or RAM if in_ram is set) as the
+// data stage of the current request, the first packet now and the rest
+// as the host reads them.
+static void usb_ep0_send(const uint8_t *addr, uint8_t len, uint16_t wLength, uint8_t in_ram)
+{
+	if (wLength < len) len = wLength;
+	ep0_data = addr;
+	ep0_data_in_ram = in_ram;
+	ep0_remaining = len;
+	ep0_state = EP0_DATA_IN;
+	UEIENX = (1<<RXSTPE)|(1<<TXINE)|(1<<RXOUTE);
+	usb_ep0_continue(UEINTX);
+}
+
 // USB Endpoint Interrupt - endpoint 0 is handled here.  The
 // other endpoints are manipulated by the user-callable
 // functions, and the start-of-frame interrupt.
 //
-ISR(USB_COM_vect)
+static inline void usb_endpoint_interrupt(void)
 {
         uint8_t intbits;
         const uint8_t *cfg;
-	uint8_t i, n, len, en;
+	uint8_t i, en;
 	uint8_t bmRequestType;
 	uint8_t bRequest;
 	uint16_t wValue;
@@ -170,10 +470,45 @@ ISR(USB_COM_vect)
 	uint8_t endpt_table_len;
 	const uint8_t *desc_addr;
 	uint8_t	desc_len;
+	uint16_t phase;
+	uint8_t frame;
+
+	if (UEINT & (1<<GAMEPAD_ENDPOINT_IN)) {
+		// The host has just read a report.  Commit the next one a
+		// little before the same point, one polling interval later.
+		phase = TCNT1 - usb_sof_time;
+		frame = usb_frame_count;
+		UENUM = GAMEPAD_ENDPOINT_IN;
+		UEIENX = 0;
+		if (phase < FRAME_TICKS) {
+			phase += FRAME_TICKS - REPORT_COMMIT_MARGIN_TICKS;
+			if (phase >= FRAME_TICKS) phase -= FRAME_TICKS;
+			else frame--;	// late in the frame before
+			if (phase < REPORT_COMMIT_MIN_TICKS) phase = REPORT_COMMIT_MIN_TICKS;
+			usb_report_offset = phase;
+			usb_commit_mask = usb_report_interval - 1;
+			usb_commit_frame = frame & usb_commit_mask;
+		}
+		if (!(UEINT & (1<<0))) return;
+	}
+	if (UEINT & (1<<GAMEPAD_ENDPOINT_OUT)) {
+		// LED and rumble commands.  Nothing to drive with them,
+		// so the packet is just released.
+		UENUM = GAMEPAD_ENDPOINT_OUT;
+		UEINTX = 0x6B;
+		if (!(UEINT & (1<<0))) return;
+	}
 
         UENUM = 0;
 	intbits = UEINTX;
+	if (ep0_state != EP0_IDLE && !(intbits & (1<<RXSTPI))) {
+		usb_ep0_continue(intbits);
+		return;
+	}
         if (intbits & (1<<RXSTPI)) {
+		// a new SETUP cancels any transfer in progress
+		ep0_state = EP0_IDLE;
+		UEIENX = (1<<RXSTPE);
                 bmRequestType = UEDATX;
                 bRequest = UEDATX;
                 wValue = UEDATX;
@@ -184,39 +519,34 @@ ISR(USB_COM_vect)
                 wLength |= (UEDATX << 8);
                 UEINTX = ~((1<<RXSTPI) | (1<<RXOUTI) | (1<<TXINI));
                 if (bRequest == GET_DESCRIPTOR) {
-		        if (get_descriptor(SP_PC, wValue, wIndex, &desc_addr, &desc_len)) {
+			if (wValue == 0x0200 && usb_config_descriptor_len) {
+				usb_ep0_send(usb_config_descriptor, usb_config_descriptor_len, wLength, 1);
+				return;
+			}
+		        if (get_descriptor(usb_profile, wValue, wIndex, &desc_addr, &desc_len)) {
 			        // Couldn't find descriptor.  Stall and return.
 			        UECONX = (1<<STALLRQ)|(1<<EPEN);
 				return;
 			}
-			len = (wLength < 256) ? wLength : 255;
-			if (len > desc_len) len = desc_len;
-			do {
-				// wait for host ready for IN packet
-				do {
-					i = UEINTX;
-				} while (!(i & ((1<<TXINI)|(1<<RXOUTI))));
-				if (i & (1<<RXOUTI)) return;	// abort
-				// send IN packet
-				n = len < ENDPOINT0_SIZE ? len : ENDPOINT0_SIZE;
-				for (i = n; i; i--) {
-					UEDATX = pgm_read_byte(desc_addr++);
-				}
-				len -= n;
-				usb_send_in();
-			} while (len || n == ENDPOINT0_SIZE);
+			usb_ep0_send(desc_addr, desc_len, wLength, 0);
 			return;
                 }
 		if (bRequest == SET_ADDRESS) {
+			ep0_address = wValue;
+			ep0_state = EP0_SET_ADDRESS;
 			usb_send_in();
-			usb_wait_in_ready();
-			UDADDR = wValue | (1<<ADDEN);
+			UEIENX = (1<<RXSTPE)|(1<<TXINE);
 			return;
 		}
 		if (bRequest == SET_CONFIGURATION && bmRequestType == 0) {
+			gamepad_report_writer = get_report_writer(usb_profile);
 			usb_configuration = wValue;
+			gamepad_report_stale = 1;
+			usb_commit_mask = 0;
+			usb_commit_frame = 0;
+			if (!boot_configured_time) boot_configured_time = timer_now_long();
 			usb_send_in();
-			get_endpoint_table(SP_PC, &endpt_table_addr, &endpt_table_len);
+			get_endpoint_table(usb_profile, &endpt_table_addr, &endpt_table_len);
 			cfg = endpt_table_addr;
 			i = 1;
 			while (endpt_table_len - (cfg - endpt_table_addr) >= 3) {
@@ -230,6 +560,11 @@ ISR(USB_COM_vect)
 			} 
         		UERST = 0x1E;
         		UERST = 0;
+			UENUM = GAMEPAD_ENDPOINT_OUT;
+			if (UECONX & (1<<EPEN)) UEIENX = (1<<RXOUTE);
+			// the input pipeline has been running all along, so
+			// the current state can go out straight away
+			usb_gamepad_send();
 			return;
 		}
 		if (bRequest == GET_CONFIGURATION && bmRequestType == 0x80) {
@@ -274,12 +609,21 @@ ISR(USB_COM_vect)
 		#endif
 		if (wIndex == GAMEPAD_INTERFACE) {
 			if (bmRequestType == 0xA1) {
-				if (bRequest == HID_GET_REPORT) {
+				if (bRequest == HID_GET_REPORT
+				  && !get_feature_report(usb_profile, wValue, wIndex, &desc_addr, &desc_len)) {
+					usb_ep0_send(desc_addr, desc_len, wLength, 0);
+					return;
+				}
+				if (bRequest == HID_GET_REPORT && (wValue >> 8) == 3
+				  && (desc_len = usb_vendor_report(wValue)) != 0) {
+					usb_ep0_send(vendor_report, desc_len, wLength, 1);
+					return;
+				}
+				// the report has to fit in one control packet
+				if (bRequest == HID_GET_REPORT
+				  && get_report_size(usb_profile) <= ep0_size) {
 					usb_wait_in_ready();
-                                        UEDATX = joystick_x;
-                                        UEDATX = joystick_y;
-                                        UEDATX = gamepad_buttons[0];
-										UEDATX = gamepad_buttons[1];
+					gamepad_report_writer(seq_buffer_current(&gamepad_state_buffer));
 					usb_send_in();
 					return;
 				}
@@ -298,13 +642,20 @@ ISR(USB_COM_vect)
 			}
 			if (bmRequestType == 0x21) {
 				if (bRequest == HID_SET_REPORT) {
-					usb_wait_receive_out();
-					usb_ack_out();
-					usb_send_in();
+					// no data stage: the status stage follows at once
+					if (wLength == 0) {
+						usb_send_in();
+						return;
+					}
+					ep0_report = wValue;
+					ep0_out_length = wLength;
+					ep0_state = EP0_DATA_OUT;
+					UEIENX = (1<<RXSTPE)|(1<<RXOUTE);
 					return;
 				}
 				if (bRequest == HID_SET_IDLE) {
 					gamepad_idle_config = (wValue >> 8);
+					gamepad_report_frame = usb_frame_count;
 					usb_send_in();
 					return;
 				}
@@ -319,4 +670,10 @@ ISR(USB_COM_vect)
 	UECONX = (1<<STALLRQ) | (1<<EPEN);	// stall
 }
 
+ISR(USB_COM_vect)
+{
+	uint16_t start = TCNT1;
 
+	usb_endpoint_interrupt();
+	loop_monitor_irq(LOOP_IRQ_USB_COM, start);
+}
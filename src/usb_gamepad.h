@@ -2,14 +2,48 @@
 #define usb_serial_h__
 
 #include <stdint.h>
+#include "usb_profiles.h"
 
-void usb_init(void);			// initialize everything
+void usb_init(Profile profile,		// initialize everything, enumerating as
+  uint8_t interval);			// profile, polled every interval frames
 uint8_t usb_configured(void);		// is the USB port configured
+void usb_set_report_interval(		// commit reports every interval
+  uint8_t interval);			// frames, no faster than polled
 
+// Publishes the latest gamepad state without blocking.  The report is
+// loaded into the endpoint at the next commit point of the frame.
 int8_t usb_gamepad_action(uint8_t x, uint8_t y, uint8_t buttons[2]);
-int8_t usb_gamepad_send(void);
 
-extern uint8_t gamepad_buttons[2];
+// Vendor feature reports, read with GET_REPORT (Feature) on the gamepad
+// interface, for example with HIDIOCGFEATURE on a Linux hidraw node.
+// They are not in the report descriptors, so the gamepad report keeps
+// its format and needs no report ID.  Byte 0 is the report ID and the
+// fields that follow are little-endian.
+//
+// Boot timing: microseconds from init_timer() to usb_init(), to the
+// first SET_CONFIGURATION and to the first report loaded after it, as
+// three 32-bit fields, 0 until the event has happened.
+#define BOOT_TIMING_REPORT_ID		0xB0
+#define BOOT_TIMING_REPORT_SIZE		13
+//
+// Input latency: the histogram of one stage of latency_stats.h, in the
+// layout described there.
+#define LATENCY_REPORT_ID(stage)	(0xB1 + (stage))
+//
+// Main loop and interrupt load: the last window of loop_monitor.h, in
+// the layout described there.
+#define LOOP_REPORT_ID			0xB5
+//
+// Switch bounce: the chatter statistics and debounce windows of the
+// inputs of one controller state byte, in the layout described in
+// input_filter.h, with room for 8 state bytes.
+#define FILTER_REPORT_ID(byte)		(0xC0 + (byte))
+//
+// Tuning: the settings in use, in the layout described in tuning.h, and
+// the command report the host writes with SET_REPORT (Feature) to change
+// them, for example with HIDIOCSFEATURE.
+#define TUNING_REPORT_ID		0xB8
+#define TUNING_COMMAND_REPORT_ID	0xB9
 
 // Everything below this point is only intended for usb_serial.c
 #ifdef USB_SERIAL_PRIVATE_INCLUDE
@@ -24,6 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "usb_profiles.h"
+#include <stddef.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
@@ -38,8 +39,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PRODUCT_ID		0xBEEF
 
 #define EP_TYPE_INTERRUPT_IN	0xC1
+#define EP_TYPE_INTERRUPT_OUT	0xC0
+#define EP_SINGLE_BUFFER        0x02
 #define EP_DOUBLE_BUFFER        0x06
-#define GAMEPAD_BUFFER		EP_DOUBLE_BUFFER
+#define GAMEPAD_BUFFER		EP_SINGLE_BUFFER
 #define GAMEPAD_SIZE		4
 
 
@@ -55,131 +58,485 @@ static const uint8_t PROGMEM endpoint_config_table[] = {
   0, // Second (optional) endpoint is OUT
 };
 
-const static uint8_t PROGMEM device_descriptor[] = {
-  18,					// bLength
-  1,					// bDescriptorType
-  LSB(0x0200), MSB(0x0200),       	// bcdUSB
-  0,					// bDeviceClass
-  0,					// bDeviceSubClass
-  0,					// bDeviceProtocol
-  ENDPOINT0_SIZE,				// bMaxPacketSize0
-  LSB(VENDOR_ID), MSB(VENDOR_ID),		// idVendor
-  LSB(PRODUCT_ID), MSB(PRODUCT_ID),	// idProduct
-  LSB(0x0100), MSB(0x0100),		// bcdDevice
-  1,					// iManufacturer
-  2,					// iProduct
-  0,					// iSerialNumber
-  1					// bNumConfigurations
+/**************************************************************************
+ * PS3 Profile Descriptors
+ *
+ * Copied byte for byte from a DualShock 3 (usb_protocol/ps3_enumeration.*),
+ * since the console matches on them.
+ **************************************************************************/
+
+#define PS3_STR_MANUFACTURER	L"Sony\0"	// the controller sends a trailing NUL
+#define PS3_STR_PRODUCT		L"PLAYSTATION(R)3 Controller"
+#define PS3_VENDOR_ID		0x054C
+#define PS3_PRODUCT_ID		0x0268
+
+#define PS3_GAMEPAD_SIZE	64
+#define PS3_ENDPOINT0_SIZE	64	// as on the controller; its reports fit one packet
+#define PS3_CONFIG1_DESC_SIZE	(9+9+9+7+7)
+#define PS3_HID_DESC_OFFSET	(9+9)
+#define PS3_FEATURE_REPORT_SIZE	49
+
+static const uint8_t PROGMEM ps3_endpoint_config_table[] = {
+  1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(PS3_GAMEPAD_SIZE) | EP_SINGLE_BUFFER,
+  1, EP_TYPE_INTERRUPT_OUT, EP_SIZE(PS3_GAMEPAD_SIZE) | EP_SINGLE_BUFFER  // LEDs and rumble
 };
 
-const static uint8_t PROGMEM gamepad_hid_report_desc[] = { 
-  0x05, 0x01,        // USAGE_PAGE (Generic Desktop)
-  0x09, 0x05,        // USAGE (Gamepad)
-  0xa1, 0x01,        // COLLECTION (Application)
-  0x09, 0x01,        //   USAGE (Pointer)
-  0xa1, 0x00,        //   COLLECTION (Physical)
-  0x09, 0x30,        //     USAGE (X)
-  0x09, 0x31,        //     USAGE (Y)
-  0x15, 0x00,        //     LOGICAL_MINIMUM (0)
-  0x26, 0xff, 0x00,  //     LOGICAL_MAXIMUM (255)
-  0x75, 0x08,        //     REPORT_SIZE (8)
-  0x95, 0x02,        //     REPORT_COUNT (2)
-  0x81, 0x02,        //     INPUT (Data,Var,Abs)
-  0xc0,              //   END_COLLECTION
-  0x05, 0x09,        //   USAGE_PAGE (Button)
-  0x19, 0x01,        //   USAGE_MINIMUM (Button 1)
-  0x29, 0x0C,        //   USAGE_MAXIMUM (Button 12)
-  0x15, 0x00,        //   LOGICAL_MINIMUM (0)
-  0x25, 0x01,        //   LOGICAL_MAXIMUM (1)
-  0x75, 0x01,        //   REPORT_SIZE (1)
-  0x95, 0x0C,        //   REPORT_COUNT (12)
-  0x81, 0x02,        //   INPUT (Data,Var,Abs)
-  0x95, 0x04,        //   REPORT_COUNT (4)
-  0x81, 0x03,        //   INPUT (Constant,Var,Abs)
-  0xc0               // END_COLLECTION
+/**************************************************************************
+ * Xbox 360 Profile Descriptors
+ *
+ * A wired controller's gamepad interface, which is what the XInput
+ * drivers bind to.  The headset and security interfaces are left out.
+ * Both endpoints are polled every frame, instead of the controller's
+ * 4 ms (IN) and 8 ms (OUT).
+ **************************************************************************/
+
+#define X360_VENDOR_ID		0x045E
+#define X360_PRODUCT_ID		0x028E
+
+#define X360_GAMEPAD_SIZE	32
+#define X360_CONFIG1_DESC_SIZE	(9+9+17+7+7)
+
+static const uint8_t PROGMEM x360_endpoint_config_table[] = {
+  1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(X360_GAMEPAD_SIZE) | EP_SINGLE_BUFFER,
+  1, EP_TYPE_INTERRUPT_OUT, EP_SIZE(X360_GAMEPAD_SIZE) | EP_SINGLE_BUFFER  // LEDs and rumble
 };
 
-#define CONFIG1_DESC_SIZE        (9+9+9+7)
-#define GAMEPAD_HID_DESC_OFFSET  (9+9)
-const static uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
-  // configuration descriptor, USB spec 9.6.3, page 264-266, Table 9-10
-  9, 					// bLength;
-  0x02,					// bDescriptorType;
-  LSB(CONFIG1_DESC_SIZE), MSB(CONFIG1_DESC_SIZE), // wTotalLength
-  1,					// bNumInterfaces
-  1,					// bConfigurationValue
-  0,					// iConfiguration
-  0x80,					// bmAttributes
-  100,					// bMaxPower
-  // interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
-  9,					// bLength
-  0x04,					// bDescriptorType
-  GAMEPAD_INTERFACE,			// bInterfaceNumber
-  0,					// bAlternateSetting
-  1,					// bNumEndpoints
-  0x03,					// bInterfaceClass (0x03 = HID)
-  0x00,					// bInterfaceSubClass (0x00 = No Boot)
-  0x00,					// bInterfaceProtocol (0x00 = No Protocol)
-  0,					// iInterface
-  // HID interface descriptor, HID 1.11 spec, section 6.2.1
-  9,					// bLength
-  0x21,					// bDescriptorType
-  LSB(0x0111), MSB(0x0111),		// bcdHID
-  0,					// bCountryCode
-  1,					// bNumDescriptors
-  0x22,					// bDescriptorType
-  sizeof(gamepad_hid_report_desc),	// wDescriptorLength
-  0,
-  // endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13
-  7,					// bLength
-  5,					// bDescriptorType
-  GAMEPAD_ENDPOINT_IN | 0x80,		// bEndpointAddress
-  0x03,					// bmAttributes (0x03=intr)
-  LSB(GAMEPAD_SIZE), MSB(GAMEPAD_SIZE),   // wMaxPacketSize
-  1					// bInterval
+// HID report descriptors.  Their sizes are taken from the bytes, so the
+// blob members and wDescriptorLength always match what is sent.
+#define GAMEPAD_HID_REPORT_DESC \
+  0x05, 0x01,        /* USAGE_PAGE (Generic Desktop) */ \
+  0x09, 0x05,        /* USAGE (Gamepad) */              \
+  0xa1, 0x01,        /* COLLECTION (Application) */     \
+  0x09, 0x01,        /*   USAGE (Pointer) */            \
+  0xa1, 0x00,        /*   COLLECTION (Physical) */      \
+  0x09, 0x30,        /*     USAGE (X) */                \
+  0x09, 0x31,        /*     USAGE (Y) */                \
+  0x15, 0x00,        /*     LOGICAL_MINIMUM (0) */      \
+  0x26, 0xff, 0x00,  /*     LOGICAL_MAXIMUM (255) */    \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */          \
+  0x95, 0x02,        /*     REPORT_COUNT (2) */         \
+  0x81, 0x02,        /*     INPUT (Data,Var,Abs) */     \
+  0xc0,              /*   END_COLLECTION */             \
+  0x05, 0x09,        /*   USAGE_PAGE (Button) */        \
+  0x19, 0x01,        /*   USAGE_MINIMUM (Button 1) */   \
+  0x29, 0x0C,        /*   USAGE_MAXIMUM (Button 12) */  \
+  0x15, 0x00,        /*   LOGICAL_MINIMUM (0) */        \
+  0x25, 0x01,        /*   LOGICAL_MAXIMUM (1) */        \
+  0x75, 0x01,        /*   REPORT_SIZE (1) */            \
+  0x95, 0x0C,        /*   REPORT_COUNT (12) */          \
+  0x81, 0x02,        /*   INPUT (Data,Var,Abs) */       \
+  0x95, 0x04,        /*   REPORT_COUNT (4) */           \
+  0x81, 0x03,        /*   INPUT (Constant,Var,Abs) */   \
+  0xc0               /* END_COLLECTION */
+#define GAMEPAD_HID_REPORT_DESC_SIZE	sizeof((const uint8_t[]){GAMEPAD_HID_REPORT_DESC})
+
+#define PS3_HID_REPORT_DESC \
+  0x05, 0x01,        /* USAGE_PAGE (Generic Desktop) */     \
+  0x09, 0x04,        /* USAGE (Joystick) */                 \
+  0xa1, 0x01,        /* COLLECTION (Application) */         \
+  0xa1, 0x02,        /*   COLLECTION (Logical) */           \
+  0x85, 0x01,        /*     REPORT_ID (1) */                \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */              \
+  0x95, 0x01,        /*     REPORT_COUNT (1) */             \
+  0x15, 0x00,        /*     LOGICAL_MINIMUM (0) */          \
+  0x26, 0xff, 0x00,  /*     LOGICAL_MAXIMUM (255) */        \
+  0x81, 0x03,        /*     INPUT (Constant,Var,Abs) */     \
+  0x75, 0x01,        /*     REPORT_SIZE (1) */              \
+  0x95, 0x13,        /*     REPORT_COUNT (19) */            \
+  0x15, 0x00,        /*     LOGICAL_MINIMUM (0) */          \
+  0x25, 0x01,        /*     LOGICAL_MAXIMUM (1) */          \
+  0x35, 0x00,        /*     PHYSICAL_MINIMUM (0) */         \
+  0x45, 0x01,        /*     PHYSICAL_MAXIMUM (1) */         \
+  0x05, 0x09,        /*     USAGE_PAGE (Button) */          \
+  0x19, 0x01,        /*     USAGE_MINIMUM (Button 1) */     \
+  0x29, 0x13,        /*     USAGE_MAXIMUM (Button 19) */    \
+  0x81, 0x02,        /*     INPUT (Data,Var,Abs) */         \
+  0x75, 0x01,        /*     REPORT_SIZE (1) */              \
+  0x95, 0x0d,        /*     REPORT_COUNT (13) */            \
+  0x06, 0x00, 0xff,  /*     USAGE_PAGE (Vendor Defined) */  \
+  0x81, 0x03,        /*     INPUT (Constant,Var,Abs) */     \
+  0x15, 0x00,        /*     LOGICAL_MINIMUM (0) */          \
+  0x26, 0xff, 0x00,  /*     LOGICAL_MAXIMUM (255) */        \
+  0x05, 0x01,        /*     USAGE_PAGE (Generic Desktop) */ \
+  0x09, 0x01,        /*     USAGE (Pointer) */              \
+  0xa1, 0x00,        /*     COLLECTION (Physical) */        \
+  0x75, 0x08,        /*       REPORT_SIZE (8) */            \
+  0x95, 0x04,        /*       REPORT_COUNT (4) */           \
+  0x35, 0x00,        /*       PHYSICAL_MINIMUM (0) */       \
+  0x46, 0xff, 0x00,  /*       PHYSICAL_MAXIMUM (255) */     \
+  0x09, 0x30,        /*       USAGE (X) */                  \
+  0x09, 0x31,        /*       USAGE (Y) */                  \
+  0x09, 0x32,        /*       USAGE (Z) */                  \
+  0x09, 0x35,        /*       USAGE (Rz) */                 \
+  0x81, 0x02,        /*       INPUT (Data,Var,Abs) */       \
+  0xc0,              /*     END_COLLECTION */               \
+  0x05, 0x01,        /*     USAGE_PAGE (Generic Desktop) */ \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */              \
+  0x95, 0x27,        /*     REPORT_COUNT (39) */            \
+  0x09, 0x01,        /*     USAGE (Pointer) */              \
+  0x81, 0x02,        /*     INPUT (Data,Var,Abs) */         \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */              \
+  0x95, 0x30,        /*     REPORT_COUNT (48) */            \
+  0x09, 0x01,        /*     USAGE (Pointer) */              \
+  0x91, 0x02,        /*     OUTPUT (Data,Var,Abs) */        \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */              \
+  0x95, 0x30,        /*     REPORT_COUNT (48) */            \
+  0x09, 0x01,        /*     USAGE (Pointer) */              \
+  0xb1, 0x02,        /*     FEATURE (Data,Var,Abs) */       \
+  0xc0,              /*   END_COLLECTION */                 \
+  0xa1, 0x02,        /*   COLLECTION (Logical) */           \
+  0x85, 0x02,        /*     REPORT_ID (2) */                \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */              \
+  0x95, 0x30,        /*     REPORT_COUNT (48) */            \
+  0x09, 0x01,        /*     USAGE (Pointer) */              \
+  0xb1, 0x02,        /*     FEATURE (Data,Var,Abs) */       \
+  0xc0,              /*   END_COLLECTION */                 \
+  0xa1, 0x02,        /*   COLLECTION (Logical) */           \
+  0x85, 0xee,        /*     REPORT_ID (238) */              \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */              \
+  0x95, 0x30,        /*     REPORT_COUNT (48) */            \
+  0x09, 0x01,        /*     USAGE (Pointer) */              \
+  0xb1, 0x02,        /*     FEATURE (Data,Var,Abs) */       \
+  0xc0,              /*   END_COLLECTION */                 \
+  0xa1, 0x02,        /*   COLLECTION (Logical) */           \
+  0x85, 0xef,        /*     REPORT_ID (239) */              \
+  0x75, 0x08,        /*     REPORT_SIZE (8) */              \
+  0x95, 0x30,        /*     REPORT_COUNT (48) */            \
+  0x09, 0x01,        /*     USAGE (Pointer) */              \
+  0xb1, 0x02,        /*     FEATURE (Data,Var,Abs) */       \
+  0xc0,              /*   END_COLLECTION */                 \
+  0xc0               /* END_COLLECTION */
+#define PS3_HID_REPORT_DESC_SIZE	sizeof((const uint8_t[]){PS3_HID_REPORT_DESC})
+
+// Every descriptor is packed into the one PROGMEM blob below, and each
+// profile has an index of (wValue, wIndex) keys with offsets into it.
+// The compiler lays out the blob and works out the offsets, so a profile
+// only has to add its members and index entries.  Fixed feature reports
+// are kept the same way, with an index keyed by GET_REPORT's wValue.
+#define CONFIG1_DESC_SIZE		(9+9+9+7)
+#define GAMEPAD_HID_DESC_OFFSET		(9+9)
+
+#define USB_STRING_DESCRIPTOR(length)	\
+  struct __attribute__((packed)) {	\
+    uint8_t bLength;			\
+    uint8_t bDescriptorType;		\
+    wchar_t wString[length];		\
+  }
+#define STRING_LENGTH(str)	(sizeof(str) / sizeof(wchar_t) - 1)
+
+struct __attribute__((packed)) descriptor_blob {
+  uint8_t pc_device[18];
+  uint8_t pc_config[CONFIG1_DESC_SIZE];
+  uint8_t pc_hid_report[GAMEPAD_HID_REPORT_DESC_SIZE];
+  USB_STRING_DESCRIPTOR(1) pc_string0;
+  USB_STRING_DESCRIPTOR(STRING_LENGTH(STR_MANUFACTURER)) pc_string1;
+  USB_STRING_DESCRIPTOR(STRING_LENGTH(STR_PRODUCT)) pc_string2;
+  uint8_t ps3_device[18];
+  uint8_t ps3_config[PS3_CONFIG1_DESC_SIZE];
+  uint8_t ps3_hid_report[PS3_HID_REPORT_DESC_SIZE];
+  USB_STRING_DESCRIPTOR(1) ps3_string0;
+  USB_STRING_DESCRIPTOR(STRING_LENGTH(PS3_STR_MANUFACTURER)) ps3_string1;
+  USB_STRING_DESCRIPTOR(STRING_LENGTH(PS3_STR_PRODUCT)) ps3_string2;
+  uint8_t ps3_feature_02[PS3_FEATURE_REPORT_SIZE];
+  uint8_t ps3_feature_ee[PS3_FEATURE_REPORT_SIZE];
+  uint8_t ps3_feature_ef[PS3_FEATURE_REPORT_SIZE];
+  uint8_t ps3_feature_f2[17];
+  uint8_t ps3_feature_f5[8];
+  uint8_t x360_device[18];
+  uint8_t x360_config[X360_CONFIG1_DESC_SIZE];
 };
 
-// If you're desperate for a little extra code memory, these strings
-// can be completely removed if iManufacturer, iProduct, iSerialNumber
-// in the device desciptor are changed to zeros.
-struct usb_string_descriptor_struct {
-  uint8_t bLength;
-  uint8_t bDescriptorType;
-  int16_t wString[];
+const static struct descriptor_blob PROGMEM descriptors = {
+  .pc_device = {
+    18,					// bLength
+    1,					// bDescriptorType
+    LSB(0x0200), MSB(0x0200),       	// bcdUSB
+    0,					// bDeviceClass
+    0,					// bDeviceSubClass
+    0,					// bDeviceProtocol
+    ENDPOINT0_SIZE,			// bMaxPacketSize0
+    LSB(VENDOR_ID), MSB(VENDOR_ID),	// idVendor
+    LSB(PRODUCT_ID), MSB(PRODUCT_ID),	// idProduct
+    LSB(0x0100), MSB(0x0100),		// bcdDevice
+    1,					// iManufacturer
+    2,					// iProduct
+    0,					// iSerialNumber
+    1					// bNumConfigurations
+  },
+
+  .pc_config = {
+    // configuration descriptor, USB spec 9.6.3, page 264-266, Table 9-10
+    9, 					// bLength;
+    0x02,				// bDescriptorType;
+    LSB(CONFIG1_DESC_SIZE), MSB(CONFIG1_DESC_SIZE), // wTotalLength
+    1,					// bNumInterfaces
+    1,					// bConfigurationValue
+    0,					// iConfiguration
+    0x80,				// bmAttributes
+    100,				// bMaxPower
+    // interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
+    9,					// bLength
+    0x04,				// bDescriptorType
+    GAMEPAD_INTERFACE,			// bInterfaceNumber
+    0,					// bAlternateSetting
+    1,					// bNumEndpoints
+    0x03,				// bInterfaceClass (0x03 = HID)
+    0x00,				// bInterfaceSubClass (0x00 = No Boot)
+    0x00,				// bInterfaceProtocol (0x00 = No Protocol)
+    0,					// iInterface
+    // HID interface descriptor, HID 1.11 spec, section 6.2.1
+    9,					// bLength
+    0x21,				// bDescriptorType
+    LSB(0x0111), MSB(0x0111),		// bcdHID
+    0,					// bCountryCode
+    1,					// bNumDescriptors
+    0x22,				// bDescriptorType
+    GAMEPAD_HID_REPORT_DESC_SIZE,	// wDescriptorLength
+    0,
+    // endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13
+    7,					// bLength
+    5,					// bDescriptorType
+    GAMEPAD_ENDPOINT_IN | 0x80,		// bEndpointAddress
+    0x03,				// bmAttributes (0x03=intr)
+    LSB(GAMEPAD_SIZE), MSB(GAMEPAD_SIZE), // wMaxPacketSize
+    1					// bInterval
+  },
+
+  .pc_hid_report = {GAMEPAD_HID_REPORT_DESC},
+
+  // If you're desperate for a little extra code memory, these strings
+  // can be completely removed if iManufacturer, iProduct, iSerialNumber
+  // in the device desciptor are changed to zeros.
+  .pc_string0 = {4, 3, {0x0409}},
+  .pc_string1 = {sizeof(STR_MANUFACTURER), 3, STR_MANUFACTURER},
+  .pc_string2 = {sizeof(STR_PRODUCT), 3, STR_PRODUCT},
+
+  .ps3_device = {
+    18,					// bLength
+    1,					// bDescriptorType
+    LSB(0x0200), MSB(0x0200),		// bcdUSB
+    0,					// bDeviceClass
+    0,					// bDeviceSubClass
+    0,					// bDeviceProtocol
+    PS3_ENDPOINT0_SIZE,			// bMaxPacketSize0
+    LSB(PS3_VENDOR_ID), MSB(PS3_VENDOR_ID),	// idVendor
+    LSB(PS3_PRODUCT_ID), MSB(PS3_PRODUCT_ID),	// idProduct
+    LSB(0x0100), MSB(0x0100),		// bcdDevice
+    1,					// iManufacturer
+    2,					// iProduct
+    0,					// iSerialNumber
+    1					// bNumConfigurations
+  },
+
+  .ps3_config = {
+    // configuration descriptor
+    9,					// bLength
+    0x02,				// bDescriptorType
+    LSB(PS3_CONFIG1_DESC_SIZE), MSB(PS3_CONFIG1_DESC_SIZE), // wTotalLength
+    1,					// bNumInterfaces
+    1,					// bConfigurationValue
+    0,					// iConfiguration
+    0x80,				// bmAttributes
+    250,				// bMaxPower (500 mA)
+    // interface descriptor
+    9,					// bLength
+    0x04,				// bDescriptorType
+    GAMEPAD_INTERFACE,			// bInterfaceNumber
+    0,					// bAlternateSetting
+    2,					// bNumEndpoints
+    0x03,				// bInterfaceClass (0x03 = HID)
+    0x00,				// bInterfaceSubClass (0x00 = No Boot)
+    0x00,				// bInterfaceProtocol (0x00 = No Protocol)
+    0,					// iInterface
+    // HID interface descriptor
+    9,					// bLength
+    0x21,				// bDescriptorType
+    LSB(0x0111), MSB(0x0111),		// bcdHID
+    0,					// bCountryCode
+    1,					// bNumDescriptors
+    0x22,				// bDescriptorType
+    LSB(PS3_HID_REPORT_DESC_SIZE), MSB(PS3_HID_REPORT_DESC_SIZE), // wDescriptorLength
+    // endpoint descriptor, OUT first as on the controller
+    7,					// bLength
+    5,					// bDescriptorType
+    GAMEPAD_ENDPOINT_OUT,		// bEndpointAddress
+    0x03,				// bmAttributes (0x03=intr)
+    LSB(PS3_GAMEPAD_SIZE), MSB(PS3_GAMEPAD_SIZE), // wMaxPacketSize
+    1,					// bInterval
+    // endpoint descriptor
+    7,					// bLength
+    5,					// bDescriptorType
+    GAMEPAD_ENDPOINT_IN | 0x80,		// bEndpointAddress
+    0x03,				// bmAttributes (0x03=intr)
+    LSB(PS3_GAMEPAD_SIZE), MSB(PS3_GAMEPAD_SIZE), // wMaxPacketSize
+    1					// bInterval
+  },
+
+  .ps3_hid_report = {PS3_HID_REPORT_DESC},
+
+  .ps3_string0 = {4, 3, {0x0409}},
+  .ps3_string1 = {sizeof(PS3_STR_MANUFACTURER), 3, PS3_STR_MANUFACTURER},
+  .ps3_string2 = {sizeof(PS3_STR_PRODUCT), 3, PS3_STR_PRODUCT},
+
+  // Feature reports read while the console (or the Linux driver) sets the
+  // controller up.  Reports 0x02, 0xEE and 0xEF only need the right size.
+  .ps3_feature_02 = {0x02},
+  .ps3_feature_ee = {0xEE},
+  .ps3_feature_ef = {0xEF},
+  // Controller information: our Bluetooth address, then fixed bytes.
+  .ps3_feature_f2 = {
+    0xF2, 0xFF, 0xFF, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,	// device address (none)
+    0x00, 0x03, 0x50, 0x81, 0xD8, 0x01, 0x8A
+  },
+  // Pairing: the Bluetooth address of the host the controller pairs with.
+  .ps3_feature_f5 = {
+    0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00	// host address (none)
+  },
+
+  .x360_device = {
+    18,					// bLength
+    1,					// bDescriptorType
+    LSB(0x0200), MSB(0x0200),		// bcdUSB
+    0xFF,				// bDeviceClass (vendor specific)
+    0xFF,				// bDeviceSubClass
+    0xFF,				// bDeviceProtocol
+    ENDPOINT0_SIZE,			// bMaxPacketSize0
+    LSB(X360_VENDOR_ID), MSB(X360_VENDOR_ID),	// idVendor
+    LSB(X360_PRODUCT_ID), MSB(X360_PRODUCT_ID),	// idProduct
+    LSB(0x0114), MSB(0x0114),		// bcdDevice
+    1,					// iManufacturer
+    2,					// iProduct
+    0,					// iSerialNumber
+    1					// bNumConfigurations
+  },
+
+  .x360_config = {
+    // configuration descriptor
+    9,					// bLength
+    0x02,				// bDescriptorType
+    LSB(X360_CONFIG1_DESC_SIZE), MSB(X360_CONFIG1_DESC_SIZE), // wTotalLength
+    1,					// bNumInterfaces
+    1,					// bConfigurationValue
+    0,					// iConfiguration
+    0xA0,				// bmAttributes (remote wakeup)
+    250,				// bMaxPower (500 mA)
+    // interface descriptor
+    9,					// bLength
+    0x04,				// bDescriptorType
+    GAMEPAD_INTERFACE,			// bInterfaceNumber
+    0,					// bAlternateSetting
+    2,					// bNumEndpoints
+    0xFF,				// bInterfaceClass (vendor specific)
+    0x5D,				// bInterfaceSubClass (XInput)
+    0x01,				// bInterfaceProtocol (gamepad)
+    0,					// iInterface
+    // XInput descriptor: the endpoints and the size of their reports
+    17,					// bLength
+    0x21,				// bDescriptorType
+    0x00, 0x01, 0x01, 0x25,
+    GAMEPAD_ENDPOINT_IN | 0x80,		// input endpoint
+    20,					// input report size
+    0x00, 0x00, 0x00, 0x00, 0x13,
+    GAMEPAD_ENDPOINT_OUT,		// output endpoint
+    8,					// output report size
+    0x00, 0x00,
+    // endpoint descriptor
+    7,					// bLength
+    5,					// bDescriptorType
+    GAMEPAD_ENDPOINT_IN | 0x80,		// bEndpointAddress
+    0x03,				// bmAttributes (0x03=intr)
+    LSB(X360_GAMEPAD_SIZE), MSB(X360_GAMEPAD_SIZE), // wMaxPacketSize
+    1,					// bInterval
+    // endpoint descriptor
+    7,					// bLength
+    5,					// bDescriptorType
+    GAMEPAD_ENDPOINT_OUT,		// bEndpointAddress
+    0x03,				// bmAttributes (0x03=intr)
+    LSB(X360_GAMEPAD_SIZE), MSB(X360_GAMEPAD_SIZE), // wMaxPacketSize
+    1					// bInterval
+  }
 };
-const static struct usb_string_descriptor_struct PROGMEM string0 = {
-  4,
-  3,
-  {0x0409}
+
+// Index entries, sorted by wValue so a lookup can stop early.
+struct descriptor_index_entry {
+  uint16_t	wValue;
+  uint16_t	wIndex;
+  uint16_t	offset;
+  uint8_t	length;
 };
-const static struct usb_string_descriptor_struct PROGMEM string1 = {
-  sizeof(STR_MANUFACTURER),
-  3,
-  STR_MANUFACTURER
+#define DESCRIPTOR(wValue, wIndex, member, length) \
+  {wValue, wIndex, offsetof(struct descriptor_blob, member), length}
+
+const static struct descriptor_index_entry PROGMEM pc_descriptor_index[] = {
+  DESCRIPTOR(0x0100, 0x0000, pc_device, 18),
+  DESCRIPTOR(0x0200, 0x0000, pc_config, CONFIG1_DESC_SIZE),
+  DESCRIPTOR(0x0300, 0x0000, pc_string0, sizeof(descriptors.pc_string0)),
+  DESCRIPTOR(0x0301, 0x0409, pc_string1, sizeof(descriptors.pc_string1)),
+  DESCRIPTOR(0x0302, 0x0409, pc_string2, sizeof(descriptors.pc_string2)),
+  DESCRIPTOR(0x2100, GAMEPAD_INTERFACE, pc_config[GAMEPAD_HID_DESC_OFFSET], 9),
+  DESCRIPTOR(0x2200, GAMEPAD_INTERFACE, pc_hid_report, GAMEPAD_HID_REPORT_DESC_SIZE)
 };
-const static struct usb_string_descriptor_struct PROGMEM string2 = {
-  sizeof(STR_PRODUCT),
-  3,
-  STR_PRODUCT
+
+const static struct descriptor_index_entry PROGMEM ps3_descriptor_index[] = {
+  DESCRIPTOR(0x0100, 0x0000, ps3_device, 18),
+  DESCRIPTOR(0x0200, 0x0000, ps3_config, PS3_CONFIG1_DESC_SIZE),
+  DESCRIPTOR(0x0300, 0x0000, ps3_string0, sizeof(descriptors.ps3_string0)),
+  DESCRIPTOR(0x0301, 0x0409, ps3_string1, sizeof(descriptors.ps3_string1)),
+  DESCRIPTOR(0x0302, 0x0409, ps3_string2, sizeof(descriptors.ps3_string2)),
+  DESCRIPTOR(0x2100, GAMEPAD_INTERFACE, ps3_config[PS3_HID_DESC_OFFSET], 9),
+  DESCRIPTOR(0x2200, GAMEPAD_INTERFACE, ps3_hid_report, PS3_HID_REPORT_DESC_SIZE)
 };
 
-// This table defines which descriptor data is sent for each specific
-// request from the host (in wValue and wIndex).
-const static struct descriptor_list_struct {
-  uint16_t	wValue;
-  uint16_t	wIndex;
-  const uint8_t	*addr;
-  uint8_t		length;
-} PROGMEM descriptor_list[] = {
-  {0x0100, 0x0000, device_descriptor, sizeof(device_descriptor)},
-  {0x0200, 0x0000, config1_descriptor, sizeof(config1_descriptor)},
-  {0x2100, GAMEPAD_INTERFACE, config1_descriptor+GAMEPAD_HID_DESC_OFFSET, 9},
-  {0x2200, GAMEPAD_INTERFACE, gamepad_hid_report_desc, sizeof(gamepad_hid_report_desc)},
-  {0x0300, 0x0000, (const uint8_t *)&string0, 4},
-  {0x0301, 0x0409, (const uint8_t *)&string1, sizeof(STR_MANUFACTURER)},
-  {0x0302, 0x0409, (const uint8_t *)&string2, sizeof(STR_PRODUCT)}
+// The strings are the PC profile's.
+const static struct descriptor_index_entry PROGMEM x360_descriptor_index[] = {
+  DESCRIPTOR(0x0100, 0x0000, x360_device, 18),
+  DESCRIPTOR(0x0200, 0x0000, x360_config, X360_CONFIG1_DESC_SIZE),
+  DESCRIPTOR(0x0300, 0x0000, pc_string0, sizeof(descriptors.pc_string0)),
+  DESCRIPTOR(0x0301, 0x0409, pc_string1, sizeof(descriptors.pc_string1)),
+  DESCRIPTOR(0x0302, 0x0409, pc_string2, sizeof(descriptors.pc_string2))
 };
-#define NUM_DESC_LIST (sizeof(descriptor_list)/sizeof(struct descriptor_list_struct))
+
+// Keyed by GET_REPORT's wValue: report type (3 = feature) and report ID.
+const static struct descriptor_index_entry PROGMEM ps3_feature_index[] = {
+  DESCRIPTOR(0x0302, GAMEPAD_INTERFACE, ps3_feature_02, PS3_FEATURE_REPORT_SIZE),
+  DESCRIPTOR(0x03EE, GAMEPAD_INTERFACE, ps3_feature_ee, PS3_FEATURE_REPORT_SIZE),
+  DESCRIPTOR(0x03EF, GAMEPAD_INTERFACE, ps3_feature_ef, PS3_FEATURE_REPORT_SIZE),
+  DESCRIPTOR(0x03F2, GAMEPAD_INTERFACE, ps3_feature_f2, sizeof(descriptors.ps3_feature_f2)),
+  DESCRIPTOR(0x03F5, GAMEPAD_INTERFACE, ps3_feature_f5, sizeof(descriptors.ps3_feature_f5))
+};
+
+// Looks (wValue, wIndex) up in an index.  Only the key is read from
+// flash until it matches.
+static int find_descriptor(
+  const struct descriptor_index_entry *entry,
+  uint8_t count,
+  uint16_t wValue,
+  uint16_t wIndex,
+  const uint8_t **descAddrOut,
+  uint8_t *descLenOut)
+{
+  uint16_t entryValue;
+
+  for (; count; count--, entry++) {
+    entryValue = pgm_read_word(&entry->wValue);
+    if (entryValue > wValue) {
+      break;
+    }
+    if (entryValue != wValue || pgm_read_word(&entry->wIndex) != wIndex) {
+      continue;
+    }
+
+    // We've found it; return the address and length.
+    *descAddrOut = (const uint8_t *)&descriptors + pgm_read_word(&entry->offset);
+    *descLenOut = pgm_read_byte(&entry->length);
+    return 0;
+  }
+
+  // Not found.
+  return 1;
+}
 
 
 int get_endpoint_table(
@@ -193,16 +550,28 @@ int get_endpoint_table(
     *endptTableLenOut = sizeof(endpoint_config_table);
     return 0;
   case SP_PS3:
-    // TODO.
-    return 1;
+    *endptTableAddrOut = ps3_endpoint_config_table;
+    *endptTableLenOut = sizeof(ps3_endpoint_config_table);
+    return 0;
   case SP_X360:
-    // TODO.
-    return 1;
+    *endptTableAddrOut = x360_endpoint_config_table;
+    *endptTableLenOut = sizeof(x360_endpoint_config_table);
+    return 0;
   default:
     return 1;
   }
 }
 
+uint8_t get_endpoint0_size(
+  Profile profile)
+{
+  switch (profile) {
+  case SP_PS3:
+    return PS3_ENDPOINT0_SIZE;
+  default:
+    return ENDPOINT0_SIZE;
+  }
+}
 
 int get_descriptor(
   Profile profile,
@@ -211,78 +580,172 @@ int get_descriptor(
   const uint8_t **descTableAddrOut,
   uint8_t *descTableLenOut)
 {
-  const uint8_t *list;
-  uint16_t desc_val;
-  uint8_t i;
-
-  // Prepare the appropriate descriptor table.
+  // Select the profile's index.
   switch (profile) {
   case SP_PC:
-    list = (const uint8_t *)descriptor_list;
-    break;
+    return find_descriptor(pc_descriptor_index,
+      sizeof(pc_descriptor_index) / sizeof(pc_descriptor_index[0]),
+      wValue, wIndex, descTableAddrOut, descTableLenOut);
   case SP_PS3:
-    // TODO.
-    break;
+    return find_descriptor(ps3_descriptor_index,
+      sizeof(ps3_descriptor_index) / sizeof(ps3_descriptor_index[0]),
+      wValue, wIndex, descTableAddrOut, descTableLenOut);
   case SP_X360:
-    // TODO.
-    break;
+    return find_descriptor(x360_descriptor_index,
+      sizeof(x360_descriptor_index) / sizeof(x360_descriptor_index[0]),
+      wValue, wIndex, descTableAddrOut, descTableLenOut);
   default:
     return 1;
   }
+}
 
-  // Loop over descriptor entries in table.
-  for (i=0; ; i++) {
 
-    // Check to see if we've overrun the table. If so, not found.
-    if (i >= NUM_DESC_LIST) {
-      return 1;
-    }
+int get_feature_report(
+  Profile profile,
+  uint16_t wValue,
+  uint16_t wIndex,
+  const uint8_t **reportAddrOut,
+  uint8_t *reportLenOut)
+{
+  switch (profile) {
+  case SP_PS3:
+    return find_descriptor(ps3_feature_index,
+      sizeof(ps3_feature_index) / sizeof(ps3_feature_index[0]),
+      wValue, wIndex, reportAddrOut, reportLenOut);
+  default:
+    return 1;
+  }
+}
 
-    // Compare the wValue from this entry.
-    desc_val = pgm_read_word(list);
-    if (desc_val != wValue) {
-      list += sizeof(struct descriptor_list_struct);
-      continue;
-    }
+/**************************************************************************
+ * Report Writers
+ **************************************************************************/
 
-    // Compare the wIndex from this entry.
-    list += 2;
-    desc_val = pgm_read_word(list);
-    if (desc_val != wIndex) {
-      list += sizeof(struct descriptor_list_struct)-2;
-      continue;
-    }
+// Console buttons driven by each gamepad button, arcade layout:
+//   1-4   square / X, cross / A, circle / B, triangle / Y
+//   5-8   L1 / LB, R1 / RB, L2 / LT, R2 / RT
+//   9-12  start, select / back, PS / guide, L3 / left stick click
+#define BUTTON(state, n)	((state)->buttons[((n) - 1) >> 3] & (1 << (((n) - 1) & 7)))
+#define BIT_IF(cond, bit)	((cond) ? (1 << (bit)) : 0)
+#define PRESSURE(cond)		((cond) ? 0xFF : 0x00)
 
-    // We've found it; return the address and length.
-    list += 2;
-    *descTableAddrOut = (const uint8_t *)pgm_read_word(list);
-    list += 2;
-    *descTableLenOut = pgm_read_byte(list);
-    return 0;
+#define PC_REPORT_SIZE		GAMEPAD_SIZE
+#define PS3_REPORT_SIZE		49
+#define X360_REPORT_SIZE	20
+
+static void write_pc_report(const struct gamepad_state *state)
+{
+  UEDATX = state->x;
+  UEDATX = state->y;
+  UEDATX = state->buttons[0];
+  UEDATX = state->buttons[1];
+}
+
+// Trailer of the DualShock 3 input report: status, battery and cable
+// bytes, then the motion sensors at rest.
+static const uint8_t PROGMEM ps3_report_trailer[] = {
+  0x00, 0x00, 0x00,			// reserved
+  0x03, 0xEF, 0x16,			// plugged in, charged, USB cable
+  0x00, 0x00, 0x00, 0x00,		// reserved
+  0x33, 0x04, 0x77, 0x01, 0x80,		// reserved
+  0x02, 0x00, 0x02, 0x00, 0x02, 0x00,	// accelerometer X, Y, Z
+  0x02, 0x00				// gyro
+};
+
+// DualShock 3 input report, report ID 1.
+static void write_ps3_report(const struct gamepad_state *state)
+{
+  uint8_t up = state->y < 128, down = state->y > 128;
+  uint8_t left = state->x < 128, right = state->x > 128;
+  uint8_t i;
+  const uint8_t *trailer = ps3_report_trailer;
+
+  UEDATX = 0x01;			// report ID
+  UEDATX = 0x00;
+  UEDATX = BIT_IF(BUTTON(state, 10), 0) | BIT_IF(BUTTON(state, 12), 1)
+    | BIT_IF(BUTTON(state, 9), 3) | BIT_IF(up, 4) | BIT_IF(right, 5)
+    | BIT_IF(down, 6) | BIT_IF(left, 7);
+  UEDATX = BIT_IF(BUTTON(state, 7), 0) | BIT_IF(BUTTON(state, 8), 1)
+    | BIT_IF(BUTTON(state, 5), 2) | BIT_IF(BUTTON(state, 6), 3)
+    | BIT_IF(BUTTON(state, 4), 4) | BIT_IF(BUTTON(state, 3), 5)
+    | BIT_IF(BUTTON(state, 2), 6) | BIT_IF(BUTTON(state, 1), 7);
+  UEDATX = BIT_IF(BUTTON(state, 11), 0);
+  UEDATX = 0x00;
+  UEDATX = 0x80;			// left stick X
+  UEDATX = 0x80;			// left stick Y
+  UEDATX = 0x80;			// right stick X
+  UEDATX = 0x80;			// right stick Y
+  UEDATX = 0x00;
+  UEDATX = 0x00;
+  UEDATX = 0x00;
+  UEDATX = 0x00;
+  // pressure: up, right, down, left, L2, R2, L1, R1, triangle, circle,
+  // cross, square
+  UEDATX = PRESSURE(up);
+  UEDATX = PRESSURE(right);
+  UEDATX = PRESSURE(down);
+  UEDATX = PRESSURE(left);
+  UEDATX = PRESSURE(BUTTON(state, 7));
+  UEDATX = PRESSURE(BUTTON(state, 8));
+  UEDATX = PRESSURE(BUTTON(state, 5));
+  UEDATX = PRESSURE(BUTTON(state, 6));
+  UEDATX = PRESSURE(BUTTON(state, 4));
+  UEDATX = PRESSURE(BUTTON(state, 3));
+  UEDATX = PRESSURE(BUTTON(state, 2));
+  UEDATX = PRESSURE(BUTTON(state, 1));
+  for (i = sizeof(ps3_report_trailer); i; i--) {
+    UEDATX = pgm_read_byte(trailer++);
   }
 }
 
-uint8_t get_report_size(
+// XInput input report.  The stick is reported on the d-pad, so the
+// analog sticks stay centred.
+static void write_x360_report(const struct gamepad_state *state)
+{
+  uint8_t i;
+
+  UEDATX = 0x00;			// message type
+  UEDATX = X360_REPORT_SIZE;		// message size
+  UEDATX = BIT_IF(state->y < 128, 0) | BIT_IF(state->y > 128, 1)
+    | BIT_IF(state->x < 128, 2) | BIT_IF(state->x > 128, 3)
+    | BIT_IF(BUTTON(state, 9), 4) | BIT_IF(BUTTON(state, 10), 5)
+    | BIT_IF(BUTTON(state, 12), 6);
+  UEDATX = BIT_IF(BUTTON(state, 5), 0) | BIT_IF(BUTTON(state, 6), 1)
+    | BIT_IF(BUTTON(state, 11), 2) | BIT_IF(BUTTON(state, 2), 4)
+    | BIT_IF(BUTTON(state, 3), 5) | BIT_IF(BUTTON(state, 1), 6)
+    | BIT_IF(BUTTON(state, 4), 7);
+  UEDATX = PRESSURE(BUTTON(state, 7));	// left trigger
+  UEDATX = PRESSURE(BUTTON(state, 8));	// right trigger
+  // sticks (4 x int16) and reserved bytes
+  for (i = X360_REPORT_SIZE - 6; i; i--) {
+    UEDATX = 0x00;
+  }
+}
+
+ReportWriter get_report_writer(
   Profile profile)
 {
   switch (profile) {
-  case SP_PC:
-    return 0;
   case SP_PS3:
-    return 0;
+    return write_ps3_report;
   case SP_X360:
-    return 0;
+    return write_x360_report;
   default:
-    return 0;
+    return write_pc_report;
   }
 }
 
-int format_report(
-  Profile profile,
-  const uint8_t rawControl[],
-  uint8_t rawControlLen,
-  uint8_t reportOut[])
+uint8_t get_report_size(
+  Profile profile)
 {
-
-  return 0;
+  switch (profile) {
+  case SP_PC:
+    return PC_REPORT_SIZE;
+  case SP_PS3:
+    return PS3_REPORT_SIZE;
+  case SP_X360:
+    return X360_REPORT_SIZE;
+  default:
+    return 0;
+  }
 }
@@ -28,8 +28,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
 
-// Common definitions used by all endpoints/descriptors.
+// Common definitions used by all endpoints/descriptors.  Endpoint 0
+// takes ENDPOINT0_SIZE byte packets, or up to ENDPOINT0_MAX_SIZE in a
+// profile whose device descriptor asks for more (see
+// get_endpoint0_size()).
 #define ENDPOINT0_SIZE		32
+#define ENDPOINT0_MAX_SIZE	64
 #define GAMEPAD_INTERFACE	0
 #define GAMEPAD_ENDPOINT_IN	1
 #define GAMEPAD_ENDPOINT_OUT    2
@@ -47,6 +51,10 @@ int get_endpoint_table(
   const uint8_t **endptTableAddrOut, // Pointer to PROGMEM
   uint8_t *endptTableLenOut);
 
+// Retrieves the endpoint 0 packet size (bMaxPacketSize0) of a profile.
+uint8_t get_endpoint0_size(
+  Profile profile);
+
 // Retrieves a pointer to the appropriate Descriptor.
 int get_descriptor(
   Profile profile,
@@ -55,16 +63,34 @@ int get_descriptor(
   const uint8_t **descAddrOut, // Pointer to PROGMEM
   uint8_t *descLenOut);
 
+// Retrieves a pointer to a fixed feature report, for GET_REPORT.  wValue
+// holds the report type and ID as in the request.
+int get_feature_report(
+  Profile profile,
+  uint16_t wValue,
+  uint16_t wIndex,
+  const uint8_t **reportAddrOut, // Pointer to PROGMEM
+  uint8_t *reportLenOut);
+
+// Gamepad state the reports are built from: stick axes (0, 128 or 255)
+// and buttons 1-12 in bits 0-11 of 'buttons'.
+struct gamepad_state {
+  uint8_t x;
+  uint8_t y;
+  uint8_t buttons[2];
+};
+
+// Writes one IN report straight into the selected endpoint's FIFO
+// (UEDATX).  Each profile has its own writer, picked once when the host
+// configures the device, so there is no per-report dispatch on profile.
+typedef void (*ReportWriter)(const struct gamepad_state *state);
+
+// Retrieves the report writer for the specified system.
+ReportWriter get_report_writer(
+  Profile profile);
+
 // Gets the USB report size for the specified system.
 uint8_t get_report_size(
   Profile profile);
 
-// Formats provided raw data into the appropriate USB report format.
-// User-provided 'reportOut' must be 'get_report_size()' bytes long.
-int format_report(
-  Profile profile,
-  const uint8_t rawControl[], // Currently: U, D, L, R, Buttons 1-8, start, select/coin, home
-  uint8_t rawControlLen,
-  uint8_t reportOut[]);
-
 #endif